@@ -4,6 +4,7 @@ float pi = 3.14159265358979E+00;
 float q  = 5.75646273248511E-03;
 float qs = 3.31368631904900E-05;
 bool update_ratings = true;
+bool fast_glicko = false;
 
 #ifdef _WIN32
 int get_console_color() {
@@ -47,19 +48,19 @@ void throw_warning(std::string msg) {
   print_status_msg(1, msg);
 }
 
-// Return a random float between 0 and 1
-float rand_float() {
-  std::random_device rdv;
-  static std::mt19937 gen(rdv());
-  std::uniform_real_distribution<float> dis(0., 1.);
-  return dis(gen);
-}
-
 // Return the square of a number
 float square(float x) {
   return x * x;
 }
 
+// Return the probability that player 1 wins a set against player 2
+float win_probability(float rating_1, float RD_1, float rating_2, float RD_2) {
+  float dif = rating_1 - rating_2;
+  float RD = sqrt(square(RD_1) + square(RD_2));
+  float g = 1. / sqrt(1. + 3. * square(q * RD / pi));
+  return 1. / (1. + pow(10., -g * dif / 400.));
+}
+
 // Take an int to the power of another int
 int int_power(int x, int n) {
   if (x == 0)
@@ -100,6 +101,14 @@ std::string get_ordinal(int a) {
   return std::to_string(a) + suffix;
 }
 
+// Get the placing of the players in a round of placings; e.g. 5th for round 4
+int get_placing(int round_id) {
+  if (round_id < 2)
+    return round_id + 1;
+  int placing = int_power(2, round_id / 2);
+  return placing + (round_id & 1) * (placing / 2) + 1;
+}
+
 // Open a file
 std::ifstream open_file(std::string fname) {
   std::ifstream infile(fname);
@@ -124,25 +133,25 @@ void load_section(std::ifstream& infile, std::vector<std::vector<int>>& out_vec)
   }
 }
 
-// Load bracket parameters from file
+// Load bracket parameters from file, in the given directory if any
 void load_bracket_params(int& num_W, int& num_L,
                          std::vector<std::vector<int>>& wl_map,
                          std::vector<std::vector<int>>& res_fixed_W,
                          std::vector<std::vector<int>>& res_fixed_L,
-                         std::vector<std::vector<int>>& res_fixed_G) {
-  std::ifstream infile = open_file("bracket_params.txt");
+                         std::vector<std::vector<int>>& res_fixed_G, std::string dir) {
+  std::ifstream infile = open_file(dir + "bracket_params.txt");
 
   // Number of players in each side of the bracket
   std::string buffer;
   std::getline(infile, buffer);
-  // Make sure num_W is a power of 2
+  // Any other size than a power of 2 is rounded up, leaving byes
   try {
     num_W = std::stoi(buffer);
-    if (((num_W & (num_W - 1)) != 0) || num_W <= 0)
+    if (num_W < 2)
       throw 1;
   } catch (...) {
     throw_error("Number of players in winners bracket = " +
-                buffer + ", must be a power of 2");
+                buffer + ", must be at least 2");
   }
   std::getline(infile, buffer);
   // Make sure num_L = num_W
@@ -167,10 +176,10 @@ void load_bracket_params(int& num_W, int& num_L,
   infile.close();
 }
 
-// Load the initial player locations from file
+// Load the initial player locations from file, in the given directory if any
 void load_initial_players(std::vector<std::string>& players_W,
-                          std::vector<std::string>& players_L) {
-  std::ifstream infile = open_file("initial_bracket.txt");
+                          std::vector<std::string>& players_L, std::string dir) {
+  std::ifstream infile = open_file(dir + "initial_bracket.txt");
   std::string name;
 
   // Winners bracket
@@ -193,8 +202,8 @@ Player::Player(std::string nam, float rat, float rd) {
   name = nam;
   rating_orig = rat;
   RD_orig = rd;
-  placings.resize(12);
   avg_points = 0.;
+  avg_points_err = 0.;
 }
 
 // Player object copy constructor
@@ -206,6 +215,8 @@ Player::Player(const Player& orig) {
   RD_orig = orig.RD_orig;
   placings = orig.placings;
   avg_points = orig.avg_points;
+  placings_err = orig.placings_err;
+  avg_points_err = orig.avg_points_err;
 }
 
 // Reset a player's rating back to its original value
@@ -222,8 +233,9 @@ void Player::update_orig_rating() {
 
 // Calculate the average number of points obtained by a player
 void Player::calc_avg_points() {
-  int t = 0;
+  int64_t t = 0;
   float p = 100.;
+  avg_points = 0.;
   for (int i = 0; i < placings.size(); i++) {
     avg_points += placings[i] * p;
     t += placings[i];
@@ -232,36 +244,264 @@ void Player::calc_avg_points() {
   avg_points /= t;
 }
 
-// Load player data from file
-playerLibrary load_player_data() {
-  playerLibrary player_library;
-  std::ifstream infile = open_file("player_data.txt");
-  std::string name;
-  float rating_orig, RD_orig;
-  while (infile >> name >> rating_orig >> RD_orig) {
-    Player* player = new Player(name, rating_orig, RD_orig);
-    player_library.insert(std::pair<std::string, Player*>(name, player));
+// Calculate the half-widths of the confidence intervals on a player's placing
+// probabilities (Wilson score intervals) and average points (normal
+// approximation), for a given number of standard deviations z. Every
+// simulation gives the player exactly one placing, so the variance of the
+// points follows from the placing counts.
+void Player::calc_intervals(float z) {
+  double n = 0., sum_sq = 0., p = 100.;
+  for (int i = 0; i < placings.size(); i++)
+    n += placings[i];
+  for (int i = 0; i < placings.size(); i++) {
+    double f = placings[i] / n;
+    placings_err[i] = 100. * z / (1. + z * z / n) *
+                      sqrt(f * (1. - f) / n + z * z / (4. * n * n));
+    sum_sq += f * p * p;
+    p *= 0.75;
+  }
+  double var = (std::max)(0., sum_sq - (double) avg_points * avg_points);
+  avg_points_err = z * sqrt(var / n);
+}
+
+// Player database constructor
+PlayerDatabase::PlayerDatabase() {
+  num_players = 0;
+  own_offsets.push_back(0);
+  own_index.assign(MIN_PLAYER_INDEX, -1);
+  mapping = NULL;
+  mapping_size = 0;
+  point_to_own();
+}
+
+PlayerDatabase::~PlayerDatabase() {
+  unmap();
+}
+
+// FNV-1a hash of a name
+uint64_t PlayerDatabase::hash(const char* name, int length) {
+  uint64_t h = 0xCBF29CE484222325ULL;
+  for (int i = 0; i < length; i++) {
+    h ^= (unsigned char) name[i];
+    h *= 0x100000001B3ULL;
+  }
+  return h;
+}
+
+// Return the name of a player
+std::string PlayerDatabase::name(int id) const {
+  return std::string(name_data + name_offsets[id], name_offsets[id + 1] - name_offsets[id]);
+}
+
+// Return the ID of the player with the given name, or -1 if there is none
+int PlayerDatabase::find(const std::string& name) const {
+  uint64_t mask = num_slots - 1;
+  for (uint64_t h = hash(name.data(), name.size()) & mask; index[h] >= 0; h = (h + 1) & mask) {
+    int id = index[h];
+    if (name_offsets[id + 1] - name_offsets[id] == name.size() &&
+        memcmp(name_data + name_offsets[id], name.data(), name.size()) == 0)
+      return id;
   }
-  return player_library;
+  return -1;
 }
 
-// Copy a player library
-playerLibrary copy_player_library(const playerLibrary& orig) {
-  playerLibrary player_library;
-  for (playerLibrary::const_iterator it = orig.begin(); it != orig.end(); it++) {
-    std::string name = (*it).first;
-    Player* player = new Player(*((*it).second));
-    player_library.insert(std::pair<std::string, Player*>(name, player));
+// Add a player, returning their ID. A name already present keeps its first
+// rating and RD.
+int PlayerDatabase::add(const std::string& name, float rating, float RD) {
+  int id = find(name);
+  if (id >= 0)
+    return id;
+  if (mapping != NULL)
+    copy_mapping();
+  id = num_players++;
+  own_names.insert(own_names.end(), name.begin(), name.end());
+  own_offsets.push_back(own_names.size());
+  own_rating.push_back(rating);
+  own_RD.push_back(RD);
+  point_to_own();
+
+  // Keep the table at most half full
+  if (2 * num_players > own_index.size())
+    rehash(2 * own_index.size());
+  else
+    insert(id);
+  return id;
+}
+
+// Put an ID into the hash table by linear probing
+void PlayerDatabase::insert(int id) {
+  uint64_t mask = own_index.size() - 1;
+  uint64_t h = hash(name_data + name_offsets[id], name_offsets[id + 1] - name_offsets[id]) & mask;
+  while (own_index[h] >= 0)
+    h = (h + 1) & mask;
+  own_index[h] = id;
+}
+
+// Rebuild the hash table with the given number of slots, a power of 2
+void PlayerDatabase::rehash(int slots) {
+  own_index.assign(slots, -1);
+  point_to_own();
+  for (int id = 0; id < num_players; id++)
+    insert(id);
+}
+
+// Point the arrays read by lookups at the database's own storage
+void PlayerDatabase::point_to_own() {
+  rating_orig = own_rating.data();
+  RD_orig = own_RD.data();
+  name_offsets = own_offsets.data();
+  name_data = own_names.data();
+  index = own_index.data();
+  num_slots = own_index.size();
+}
+
+// Copy a mapped file into the database's own storage, so it can be added to
+void PlayerDatabase::copy_mapping() {
+  own_rating.assign(rating_orig, rating_orig + num_players);
+  own_RD.assign(RD_orig, RD_orig + num_players);
+  own_offsets.assign(name_offsets, name_offsets + num_players + 1);
+  own_names.assign(name_data, name_data + name_offsets[num_players]);
+  own_index.assign(index, index + num_slots);
+  unmap();
+  point_to_own();
+}
+
+void PlayerDatabase::unmap() {
+#ifdef __linux__
+  if (mapping != NULL)
+    munmap(mapping, mapping_size);
+#endif
+  mapping = NULL;
+  mapping_size = 0;
+}
+
+// Layout of a binary ratings file: the header, then the ratings, the RDs, the
+// offsets of the names in the string table (one past the last too), the hash
+// table, and the string table
+static size_t ratings_file_size(const RatingsHeader& header) {
+  return sizeof(RatingsHeader) + 2 * header.num_players * sizeof(float) +
+         (header.num_players + 1) * sizeof(uint32_t) + header.num_slots * sizeof(int32_t) +
+         header.names_size;
+}
+
+// Write the database as a binary ratings file
+void PlayerDatabase::save(std::string fname) const {
+  RatingsHeader header;
+  memcpy(header.magic, RATINGS_MAGIC, sizeof(header.magic));
+  header.version = RATINGS_VERSION;
+  header.num_players = num_players;
+  header.num_slots = num_slots;
+  header.names_size = name_offsets[num_players];
+  header.file_size = ratings_file_size(header);
+
+  FILE* out = fopen(fname.c_str(), "wb");
+  if (out == NULL)
+    throw_error("Unable to write " + fname);
+  fwrite(&header, sizeof(header), 1, out);
+  fwrite(rating_orig, sizeof(float), num_players, out);
+  fwrite(RD_orig, sizeof(float), num_players, out);
+  fwrite(name_offsets, sizeof(uint32_t), num_players + 1, out);
+  fwrite(index, sizeof(int32_t), num_slots, out);
+  fwrite(name_data, 1, header.names_size, out);
+  if (fclose(out) != 0)
+    throw_error("Unable to write " + fname);
+}
+
+// Map a binary ratings file into memory and read the database straight from
+// it. Returns false, leaving the database as it was, if the file cannot be
+// mapped, is not a ratings file of this version, or is inconsistent.
+bool PlayerDatabase::map(std::string fname) {
+#ifdef __linux__
+  int fd = open(fname.c_str(), O_RDONLY);
+  if (fd < 0)
+    return false;
+  struct stat st;
+  if (fstat(fd, &st) != 0 || st.st_size < sizeof(RatingsHeader)) {
+    close(fd);
+    return false;
+  }
+  void* data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (data == MAP_FAILED)
+    return false;
+
+  const RatingsHeader* header = (const RatingsHeader*) data;
+  if (memcmp(header->magic, RATINGS_MAGIC, sizeof(header->magic)) != 0 ||
+      header->version != RATINGS_VERSION || header->file_size != st.st_size ||
+      ratings_file_size(*header) != st.st_size || header->num_slots == 0 ||
+      (header->num_slots & (header->num_slots - 1)) != 0 ||
+      header->num_slots < 2 * (uint64_t) header->num_players ||
+      header->num_players > INT32_MAX || header->num_slots > INT32_MAX) {
+    munmap(data, st.st_size);
+    return false;
+  }
+  const char* p = (const char*) data + sizeof(RatingsHeader);
+  const uint32_t* offsets = (const uint32_t*) (p + 2 * header->num_players * sizeof(float));
+  const int32_t* slots = (const int32_t*) (offsets + header->num_players + 1);
+
+  // The names must lie in the string table, one after another, and every
+  // player must be in the hash table exactly once, for lookups to stay in
+  // bounds and end
+  bool valid = offsets[0] == 0 && offsets[header->num_players] == header->names_size;
+  for (uint32_t i = 0; valid && i < header->num_players; i++)
+    valid = offsets[i] <= offsets[i + 1];
+  std::vector<bool> indexed(header->num_players, false);
+  uint32_t num_indexed = 0;
+  for (uint32_t h = 0; valid && h < header->num_slots; h++) {
+    if (slots[h] == -1)
+      continue;
+    valid = slots[h] >= 0 && (uint32_t) slots[h] < header->num_players && !indexed[slots[h]];
+    if (valid) {
+      indexed[slots[h]] = true;
+      num_indexed++;
+    }
+  }
+  if (!valid || num_indexed != header->num_players) {
+    munmap(data, st.st_size);
+    return false;
   }
-  return player_library;
+
+  unmap();
+  mapping = data;
+  mapping_size = st.st_size;
+  num_players = header->num_players;
+  num_slots = header->num_slots;
+  rating_orig = (const float*) p;
+  p += num_players * sizeof(float);
+  RD_orig = (const float*) p;
+  p += num_players * sizeof(float);
+  name_offsets = (const uint32_t*) p;
+  p += (num_players + 1) * sizeof(uint32_t);
+  index = (const int32_t*) p;
+  p += num_slots * sizeof(int32_t);
+  name_data = p;
+  return true;
+#else
+  return false;
+#endif
 }
 
-// Reset all player ratings and RDs
-void reset_players(playerLibrary player_library) {
-  for (playerLibrary::iterator it = player_library.begin();
-       it != player_library.end(); it++) {
-    (*it).second->reset_rating();
+// Load player data: from the binary ratings file if allowed and there is one
+// at least as new as player_data.txt, otherwise by parsing player_data.txt
+void load_player_data(PlayerDatabase& database, bool binary) {
+#ifdef __linux__
+  struct stat st_bin, st_txt;
+  if (binary && stat(RATINGS_FILE, &st_bin) == 0) {
+    if (stat("player_data.txt", &st_txt) == 0 && st_txt.st_mtime > st_bin.st_mtime)
+      throw_warning(std::string(RATINGS_FILE) + " is older than player_data.txt, which is "
+                    "used instead; run convert_ratings to update it");
+    else if (database.map(RATINGS_FILE))
+      return;
+    else
+      throw_warning(std::string(RATINGS_FILE) + " is not a valid ratings file; "
+                    "using player_data.txt instead");
   }
+#endif
+  std::ifstream infile = open_file("player_data.txt");
+  std::string name;
+  float rating_orig, RD_orig;
+  while (infile >> name >> rating_orig >> RD_orig)
+    database.add(name, rating_orig, RD_orig);
 }
 
 // Match object constructor
@@ -270,6 +510,7 @@ Match::Match(std::string nam, char sid, int rid, int i) {
   side = sid;
   round_id = rid;
   index = i;
+  op = -1;
 }
 
 // Set the structure of a match; i.e. where the winner and loser go next
@@ -293,99 +534,6 @@ void Match::set_structure_gf1(Match* w_wt, int w_wti, Match* l_lt, int l_lti,
   lside_wt_index = l_wti;  // 0
 }
 
-// Set the players taking place in a match
-void Match::set_players(Player* p1, Player* p2) {
-  player_1 = p1;
-  player_2 = p2;
-}
-
-// Simulate a match
-void Match::simulate() {
-  float dif, RD, g, E;
-  int s1, s2;
-
-  result = result_fixed;
-  assert(result == 0 || result == 1 || result == 2);
-
-  // Determine a winner
-  if (result == 0) {
-    dif = player_1->rating - player_2->rating;
-    RD = sqrt(square(player_1->RD) + square(player_2->RD));
-    g = 1. / sqrt(1. + 3. * square(q * RD / pi));
-    E = 1. / (1. + pow(10., -g * dif / 400.));
-    if (E > rand_float())
-      result = 1;  // Player 1 wins
-    else
-      result = 2;  // Player 2 wins
-  }
-
-  if (result == 1) {  // Player 1 has won
-    s1 = 1;
-    s2 = 0;
-    winner = player_1;
-    loser = player_2;
-  } else {  // Player 2 has won
-    s1 = 0;
-    s2 = 1;
-    winner = player_2;
-    loser = player_1;
-  }
-
-  // Send the players to their next match
-  // assert(wt_index == 0 || wt_index == 1);
-  // assert(lt_index == 0 || lt_index == 1);
-  if (side == 'G' && round_id == 1) {  // Grand finals set 1
-    if (result == 1) {  // Player from winners bracket wins
-      bracket_reset = false;
-      if (wside_wt_index == 0)
-        wside_winner_to->player_1 = winner;
-      else
-        wside_winner_to->player_2 = winner;
-      if (lside_lt_index == 0)
-        lside_loser_to->player_1 = loser;
-      else
-        lside_loser_to->player_2 = loser;
-    } else {  // Player from losers bracket wins
-      bracket_reset = true;
-      if (wside_lt_index == 0)
-        wside_loser_to->player_1 = loser;
-      else
-        wside_loser_to->player_2 = loser;
-      if (lside_wt_index == 0)
-        lside_winner_to->player_1 = winner;
-      else
-        lside_winner_to->player_2 = winner;
-    }
-  } else {  // Every other set
-    if (wt_index == 0)
-      winner_to->player_1 = winner;
-    else
-      winner_to->player_2 = winner;
-    if (lt_index == 0)
-      loser_to->player_1 = loser;
-    else
-      loser_to->player_2 = loser;
-  }
-
-  // Update ratings and RDs
-  if (update_ratings) {
-    float g1, g2, E1, E2, x1, x2, y1, y2;
-    dif = player_1->rating - player_2->rating;
-    g1 = 1. / sqrt(1. + 3. * square(q * player_1->RD / pi));
-    g2 = 1. / sqrt(1. + 3. * square(q * player_2->RD / pi));
-    E1 = 1. / (1. + pow(10., -g2 * dif / 400.));
-    E2 = 1. / (1. + pow(10.,  g1 * dif / 400.));
-    x1 = 1. / (square(player_1->RD));
-    x2 = 1. / (square(player_2->RD));
-    y1 = qs * square(g2) * E1 * (1. - E1);  // 1/(d^2)
-    y2 = qs * square(g1) * E2 * (1. - E2);  // 1/(d^2)
-    player_1->RD = (std::max)(30., sqrt(1. / (x1 + y1)));
-    player_2->RD = (std::max)(30., sqrt(1. / (x2 + y2)));
-    player_1->rating += q * g2 * (s1 - E1) / (x1 + y1);
-    player_2->rating += q * g1 * (s2 - E2) / (x2 + y2);
-  }
-}
-
 // Round object constructor
 Round::Round(char sid, int rid) {
   side = sid;
@@ -426,14 +574,7 @@ Round::Round(char sid, int rid) {
       num_matches = 1;
     else
       num_matches = int_power(2, round_id / 2 - 2);
-    int placing;
-    if (round_id < 2) {
-      placing = round_id + 1;
-    } else {
-      placing = int_power(2, round_id / 2);
-      placing += (round_id & 1) * (placing / 2) + 1;
-    }
-    name = get_ordinal(placing) + " Place";
+    name = get_ordinal(get_placing(round_id)) + " Place";
   }
 
   // Create match objects
@@ -443,17 +584,19 @@ Round::Round(char sid, int rid) {
   }
 }
 
-// Set the results of the matches in a round that are already known
-void Round::set_res_fixed(std::vector<int> res_fixed) {
-  for (int i = 0; i < res_fixed.size(); i++)
-    matches[i]->result_fixed = res_fixed[i];
+// Round object destructor
+Round::~Round() {
+  for (int i = 0; i < matches.size(); i++)
+    delete matches[i];
 }
 
-// Simulate all the matches in a round
-void Round::simulate() {
-  for (std::vector<Match*>::iterator it = matches.begin();
-       it != matches.end(); it++)
-    (*it)->simulate();
+// Bracket object destructor
+Bracket::~Bracket() {
+  for (std::vector<Round*>* side : {&winners, &losers, &grands, &placings})
+    for (std::vector<Round*>::iterator it = side->begin(); it != side->end(); it++)
+      delete *it;
+  for (int i = 0; i < players_in_bracket.size(); i++)
+    delete players_in_bracket[i];
 }
 
 // Bracket object constructor
@@ -487,15 +630,33 @@ Bracket::Bracket(int numw, int numl) {
     Round* round = new Round('P', i);
     placings.push_back(round);
   }
+
+  // Give every match (placings included) two consecutive program seats
+  int num_seats = 0;
+  for (std::vector<Round*>* side : {&winners, &losers, &grands, &placings})
+    for (std::vector<Round*>::iterator it = side->begin(); it != side->end(); it++)
+      for (int i = 0; i < (*it)->num_matches; i++) {
+        (*it)->matches[i]->seat = num_seats;
+        num_seats += 2;
+      }
+  seats.resize(num_seats);
+
+  // No importance sampling unless a target is set
+  target = -1;
+  tilt = 0.;
+  weight = 1.;
+  weighted_placings = weighted_placings_sq = NULL;
+  strata_placings = NULL;
 }
 
-// Set the player library to use for the bracket
-void Bracket::set_player_library(playerLibrary pys) {
-  player_library = pys;
+// Set the player database to draw the bracket's players from. It is only
+// read, so every thread's bracket can share it.
+void Bracket::set_player_database(const PlayerDatabase* db) {
+  database = db;
 }
 
 // Setup the bracket structure; i.e. where the winner and loser of every match goes next
-void Bracket::set_structure(std::vector<std::vector<int>> wl_map) {
+void Bracket::set_structure(const std::vector<std::vector<int>>& wl_map) {
   // Winners finals
   winners[0]->matches[0]->set_structure(grands[1]->matches[0], 0,
                                         losers[0]->matches[0], 0);
@@ -533,108 +694,657 @@ void Bracket::set_structure(std::vector<std::vector<int>> wl_map) {
                                            placings[1]->matches[0], 0,
                                            grands[0]->matches[0], 1,
                                            grands[0]->matches[0], 0);
+
+  compile_program();
 }
 
-// Set the initial player locations
-void Bracket::set_initial_players(std::vector<std::string> players_W,
-                                  std::vector<std::string> players_L, int t) {
-  std::string name;
-  Player* player, *player_1, *player_2;
+// Flatten the match graph into the bracket program: one entry per set, in the
+// order the sets are played, with destinations resolved to seat indices.
+//
+// Sets with a bye are resolved here rather than played. Whether a seat holds a
+// bye is known in advance: a set between a player and a bye sends the player
+// on as its winner and the bye on as its loser, and a set between two byes
+// sends byes both ways. Such a set is left out of the program, and the seat of
+// its player is redirected to the set's winner seat, so whichever set (or
+// initial placement) would have filled it fills the winner seat directly.
+void Bracket::compile_program() {
+  std::vector<Match*> order_matches;
+  std::vector<MatchOp> full;
+  std::vector<Round*> order(winners.rbegin(), winners.rend());
+  order.insert(order.end(), losers.rbegin(), losers.rend());
+  for (std::vector<Round*>::iterator it = order.begin(); it != order.end(); it++)
+    for (int i = 0; i < (*it)->num_matches; i++) {
+      Match* match = (*it)->matches[i];
+      MatchOp op;
+      op.seat = match->seat;
+      op.winner_to[0] = op.winner_to[1] = match->winner_to->seat + match->wt_index;
+      op.loser_to[0] = op.loser_to[1] = match->loser_to->seat + match->lt_index;
+      op.result_fixed = 0;
+      op.conditional = false;
+      order_matches.push_back(match);
+      full.push_back(op);
+    }
+
+  // Grand finals set 1: where the players go depends on who wins
+  Match* gf1 = grands[1]->matches[0];
+  MatchOp op;
+  op.seat = gf1->seat;
+  op.winner_to[0] = gf1->wside_winner_to->seat + gf1->wside_wt_index;
+  op.loser_to[0] = gf1->lside_loser_to->seat + gf1->lside_lt_index;
+  op.winner_to[1] = gf1->lside_winner_to->seat + gf1->lside_wt_index;
+  op.loser_to[1] = gf1->wside_loser_to->seat + gf1->wside_lt_index;
+  op.result_fixed = 0;
+  op.conditional = false;
+  order_matches.push_back(gf1);
+  full.push_back(op);
+
+  // Grand finals set 2: only played on a bracket reset
+  Match* gf2 = grands[0]->matches[0];
+  op.seat = gf2->seat;
+  op.winner_to[0] = op.winner_to[1] = gf2->winner_to->seat + gf2->wt_index;
+  op.loser_to[0] = op.loser_to[1] = gf2->loser_to->seat + gf2->lt_index;
+  op.conditional = true;
+  order_matches.push_back(gf2);
+  full.push_back(op);
+
+  // Find the sets with byes, following the byes through the bracket
+  std::vector<bool> bye = bye_seats;
+  bye.resize(seats.size(), false);
+  redirect.assign(seats.size(), -1);
+  std::vector<bool> kept(full.size(), true);
+  for (int k = 0; k < full.size(); k++) {
+    bool bye_1 = bye[full[k].seat], bye_2 = bye[full[k].seat + 1];
+    if (!bye_1 && !bye_2)
+      continue;
+    if (full[k].winner_to[0] != full[k].winner_to[1])
+      throw_error("Too many byes; grand finals must be played");
+    kept[k] = false;
+    bye[full[k].loser_to[0]] = true;
+    if (bye_1 && bye_2)
+      bye[full[k].winner_to[0]] = true;
+    else
+      redirect[full[k].seat + (bye_1 ? 1 : 0)] = full[k].winner_to[0];
+  }
+
+  program.clear();
+  for (int k = 0; k < full.size(); k++) {
+    if (!kept[k]) {
+      order_matches[k]->op = -1;
+      continue;
+    }
+    for (int r = 0; r < 2; r++) {
+      full[k].winner_to[r] = resolve_seat(full[k].winner_to[r]);
+      full[k].loser_to[r] = resolve_seat(full[k].loser_to[r]);
+    }
+    order_matches[k]->op = program.size();
+    program.push_back(full[k]);
+  }
+  results.assign(program.size(), 0);
+
+  // Seats whose occupants finish in each placing
+  placing_seats.clear();
+  for (int i = 0; i < num_rounds_P; i++)
+    for (int j = 0; j < placings[i]->num_matches; j++) {
+      PlacingSeat ps;
+      ps.seat = placings[i]->matches[j]->seat;
+      ps.placing = i;
+      if (!bye[ps.seat])
+        placing_seats.push_back(ps);
+      // 1st-4th place: 1 player each
+      if (i >= 4 && !bye[ps.seat + 1]) {
+        ps.seat += 1;
+        placing_seats.push_back(ps);
+      }
+    }
+}
 
+// Follow a seat through the sets with byes to the seat its player actually
+// fills
+int Bracket::resolve_seat(int seat) {
+  while (redirect[seat] >= 0)
+    seat = redirect[seat];
+  return seat;
+}
+
+// Find a player in the database, using default values if they are not found,
+// and add a copy of them to the bracket, returning their ID within it. Only
+// the players in the bracket are copied, with placings sized to its own.
+int Bracket::place_player(const std::string& name, int t) {
   float rating_default = 1600.;
   float RD_default = 200.;
 
+  Player* player;
+  int id = database->find(name);
+  if (id >= 0) {
+    player = new Player(name, database->rating_orig[id], database->RD_orig[id]);
+  } else {
+    if (t == 0)
+      throw_warning("Player \"" + name + "\" not found. Using default rating, RD of " +
+                    std::to_string(rating_default) + ", " + std::to_string(RD_default));
+    player = new Player(name, rating_default, RD_default);
+  }
+  player->placings.resize(num_rounds_P);
+  player->placings_err.resize(num_rounds_P);
+  players_in_bracket.push_back(player);
+  return players_in_bracket.size() - 1;
+}
+
+// Set the initial player locations. Seats named BYE, and any left over after
+// the listed players, are byes, which are resolved before any simulation.
+void Bracket::set_initial_players(const std::vector<std::string>& players_W,
+                                  const std::vector<std::string>& players_L, int t) {
+  int size_W = 2 * winners.back()->num_matches;
+  int size_L = num_L == 0 ? 0 : 2 * losers.back()->num_matches;
+  if (players_W.size() > size_W)
+    throw_error(std::to_string(players_W.size()) + " players listed in winners bracket, "
+                "must be at most " + std::to_string(size_W));
+  if (players_L.size() > size_L)
+    throw_error(std::to_string(players_L.size()) + " players listed in losers bracket, "
+                "must be at most " + std::to_string(size_L));
+
+  bye_seats.assign(seats.size(), false);
+  for (int i = 0; i < size_W; i++)
+    bye_seats[winners.back()->matches[i / 2]->seat + i % 2] =
+      i >= players_W.size() || players_W[i] == BYE;
+  for (int i = 0; i < size_L; i++)
+    bye_seats[losers.back()->matches[i / 2]->seat + i % 2] =
+      i >= players_L.size() || players_L[i] == BYE;
+  compile_program();
+
   // Winners bracket
-  int i = 0;
-  for (std::vector<std::string>::iterator it = players_W.begin();
-       it != players_W.end(); it++) {
-    std::string name = *it;
-    // If player not found, create player with default values
-    if (player_library.find(name) == player_library.end()) {
-      if (t == 0)
-        throw_warning("Player \"" + name + "\" not found. Using default rating, RD of " +
-                      std::to_string(rating_default) + ", " + std::to_string(RD_default));
-      player = new Player(name, rating_default, RD_default);
-      player_library.insert(std::pair<std::string, Player*>(name, player));
+  initial_seats_W.clear();
+  for (int i = 0; i < size_W; i++) {
+    int seat = winners.back()->matches[i / 2]->seat + i % 2;
+    initial_seats_W.push_back(bye_seats[seat] ? -1 : resolve_seat(seat));
+    if (!bye_seats[seat])
+      seats[initial_seats_W.back()] = place_player(players_W[i], t);
+  }
+
+  // Losers bracket
+  initial_seats_L.clear();
+  for (int i = 0; i < size_L; i++) {
+    int seat = losers.back()->matches[i / 2]->seat + i % 2;
+    initial_seats_L.push_back(bye_seats[seat] ? -1 : resolve_seat(seat));
+    if (!bye_seats[seat])
+      seats[initial_seats_L.back()] = place_player(players_L[i], t);
+  }
+
+  build_tables();
+}
+
+// Recompute the cached terms that depend on a player's RD
+void Bracket::cache_RD(int id) {
+  g_RD[id] = 1. / sqrt(1. + 3. * square(q * RD[id] / pi));
+  inv_RD_sq[id] = 1. / (square(RD[id]));
+}
+
+// Build the lookup tables indexed by player ID: the probability of every
+// player beating every other with static ratings (for fields of up to
+// MAX_WIN_PROB_TABLE players), and the RD terms of each player's rating update
+void Bracket::build_tables() {
+  num_players = players_in_bracket.size();
+  live.assign(4 * num_players, 0.);
+  live_orig.assign(4 * num_players, 0.);
+  rating = live.data();
+  RD = rating + num_players;
+  g_RD = RD + num_players;
+  inv_RD_sq = g_RD + num_players;
+  rating_orig = live_orig.data();
+  RD_orig = rating_orig + num_players;
+  placing_counts = cache_aligned(placing_buffer, num_players * num_rounds_P);
+  for (int i = 0; i < num_players; i++) {
+    rating_orig[i] = players_in_bracket[i]->rating_orig;
+    RD_orig[i] = players_in_bracket[i]->RD_orig;
+  }
+
+  win_prob.clear();
+  if (!update_ratings && num_players <= MAX_WIN_PROB_TABLE) {
+    win_prob.resize(num_players * num_players);
+    for (int i = 0; i < num_players; i++)
+      for (int j = 0; j < num_players; j++)
+        win_prob[i * num_players + j] =
+          win_probability(rating_orig[i], RD_orig[i], rating_orig[j], RD_orig[j]);
+  }
+
+  reload_ratings();
+}
+
+// Recompute the RD terms of the snapshot restored at the start of each
+// simulation, after the original ratings and RDs have changed (e.g. carried
+// over from a previous event). Only the rating-update terms are refreshed;
+// the static win probabilities are not.
+void Bracket::reload_ratings() {
+  memcpy(rating, rating_orig, 2 * num_players * sizeof(float));
+  for (int i = 0; i < num_players; i++)
+    cache_RD(i);
+  memcpy(live_orig.data(), live.data(), live.size() * sizeof(float));
+}
+
+// Set the results of the matches in a round that are already known
+void Bracket::set_round_res_fixed(std::vector<Round*>& rounds,
+                                  const std::vector<std::vector<int>>& res_fixed) {
+  for (int i = 0; i < res_fixed.size(); i++)
+    for (int j = 0; j < res_fixed[i].size(); j++) {
+      assert(res_fixed[i][j] == 0 || res_fixed[i][j] == 1 || res_fixed[i][j] == 2);
+      if (rounds[i]->matches[j]->op >= 0)  // Not a set with a bye
+        program[rounds[i]->matches[j]->op].result_fixed = res_fixed[i][j];
     }
-    // Place the players in winners bracket
-    if (i % 2 == 0) {
-      player_1 = player_library.find(name)->second;
-    } else {
-      player_2 = player_library.find(name)->second;
-      winners.back()->matches[i / 2]->set_players(player_1, player_2);
-      players_in_bracket.push_back(player_1);
-      players_in_bracket.push_back(player_2);
+}
+
+// Set the results of the matches in a bracket that are already known
+void Bracket::set_res_fixed(const std::vector<std::vector<int>>& res_fixed_W,
+                            const std::vector<std::vector<int>>& res_fixed_L,
+                            const std::vector<std::vector<int>>& res_fixed_G) {
+  set_round_res_fixed(winners, res_fixed_W);
+  set_round_res_fixed(losers, res_fixed_L);
+  set_round_res_fixed(grands, res_fixed_G);
+}
+
+// Update player results (post-simulation)
+void Bracket::update_player_results() {
+  for (std::vector<PlacingSeat>::iterator it = placing_seats.begin();
+       it != placing_seats.end(); it++)
+    placing_counts[seats[it->seat] * num_rounds_P + it->placing] += 1;
+  if (!strata.empty())
+    update_strata(results.data(), seats.data(), 1);
+  if (target >= 0)
+    for (std::vector<PlacingSeat>::iterator it = placing_seats.begin();
+         it != placing_seats.end(); it++) {
+      int x = seats[it->seat] * num_rounds_P + it->placing;
+      weighted_placings[x] += weight;
+      weighted_placings_sq[x] += weight * weight;
     }
-    i++;
+}
+
+// Clear the placings of the players and those counted since the last merge
+void Bracket::clear_placings() {
+  for (int i = 0; i < num_players; i++)
+    std::fill(players_in_bracket[i]->placings.begin(), players_in_bracket[i]->placings.end(), 0);
+  std::fill(placing_counts, placing_counts + num_players * num_rounds_P, 0);
+}
+
+// Tilt every set played by the target player so that they win it with at
+// least the given probability, for importance sampling
+void Bracket::set_target(int id, float min_win_prob) {
+  target = id;
+  tilt = min_win_prob;
+  weighted_placings = cache_aligned(weighted_buffer, num_players * num_rounds_P);
+  weighted_placings_sq = cache_aligned(weighted_sq_buffer, num_players * num_rounds_P);
+}
+
+// Choose the sets whose results the placings are stratified by
+void Bracket::set_strata(const std::vector<int>& ops) {
+  strata = ops;
+  num_strata_placings = num_rounds_P;
+  strata_placings = cache_aligned(strata_buffer,
+                                  num_players * num_strata_placings * strata.size() * 2);
+  strata_index.resize(2 * strata.size());
+}
+
+// Count the placings of a simulation by the results of the stratified sets,
+// given the result of each set and the player in each seat, [index * stride].
+// For each player and placing, the counts for every set with result 1 are
+// followed by those with result 2, so a simulation adds two contiguous rows of
+// 0s and 1s per placing, which vectorizes.
+void Bracket::update_strata(const int* res, const int* occupants, int stride) {
+  int num_strata = strata.size();
+  int* won_1 = strata_index.data();
+  int* won_2 = won_1 + num_strata;
+  for (int m = 0; m < num_strata; m++) {
+    int r = res[strata[m] * stride];
+    won_1[m] = r == 1;
+    won_2[m] = r == 2;
+  }
+  for (std::vector<PlacingSeat>::iterator it = placing_seats.begin();
+       it != placing_seats.end(); it++) {
+    int64_t* counts = &strata_placings[(occupants[it->seat * stride] * num_strata_placings +
+                                    it->placing) * 2 * num_strata];
+    #pragma omp simd
+    for (int m = 0; m < 2 * num_strata; m++)
+      counts[m] += won_1[m];
   }
+}
 
-  // Losers bracket
-  i = 0;
-  for (std::vector<std::string>::iterator it = players_L.begin();
-       it != players_L.end(); it++) {
-    std::string name = *it;
-    // If player not found, create player with default values
-    if (player_library.find(name) == player_library.end()) {
-      if (t == 0)
-        throw_warning("Player \"" + name + "\" not found. Using default rating, RD of " +
-                      std::to_string(rating_default) + ", " + std::to_string(RD_default));
-      player = new Player(name, rating_default, RD_default);
-      player_library.insert(std::pair<std::string, Player*>(name, player));
+// Simulate the full bracket and record where every player placed
+void Bracket::simulate(const RandomStream& rng) {
+  play(rng);
+  update_player_results();
+}
+
+// Play every set of the bracket by running the bracket program, recording the
+// result of each in `results` (0 for a set that was not played)
+void Bracket::play(const RandomStream& rng) {
+  memcpy(live.data(), live_orig.data(), live.size() * sizeof(float));
+  const GlickoConstants constants(pi, q, qs);
+  weight = 1.;
+  int result = 0;
+  for (int k = 0; k < program.size(); k++) {
+    const MatchOp* op = &program[k];
+    if (op->conditional && result != 2) {
+      results[k] = 0;
+      continue;
+    }
+
+    float dif;
+    int s1, s2;
+    int id_1 = seats[op->seat];
+    int id_2 = seats[op->seat + 1];
+
+    // Determine a winner
+    result = op->result_fixed;
+    if (result == 0) {
+      float E;
+      if (!win_prob.empty())
+        E = win_prob[id_1 * num_players + id_2];
+      else if (fast_glicko)
+        E = fast_win_probability(rating[id_1], RD[id_1], rating[id_2], RD[id_2], constants);
+      else
+        E = win_probability(rating[id_1], RD[id_1], rating[id_2], RD[id_2]);
+      if (target >= 0 && (id_1 == target || id_2 == target)) {
+        // Draw from the tilted probability instead, and weight the
+        // simulation by the likelihood ratio of the result
+        float E_target = id_1 == target ? E : 1. - E;
+        float Q_target = (std::max)(E_target, tilt);
+        float Q = id_1 == target ? Q_target : 1. - Q_target;
+        if (Q > rng.uniform(k)) {
+          result = 1;
+          weight *= E / Q;
+        } else {
+          result = 2;
+          weight *= (1. - E) / (1. - Q);
+        }
+      } else if (E > rng.uniform(k)) {
+        result = 1;  // Player 1 wins
+      } else {
+        result = 2;  // Player 2 wins
+      }
+    }
+
+    // Send the players to their next match
+    if (result == 1) {  // Player 1 has won
+      s1 = 1;
+      s2 = 0;
+      seats[op->winner_to[0]] = id_1;
+      seats[op->loser_to[0]] = id_2;
+    } else {  // Player 2 has won
+      s1 = 0;
+      s2 = 1;
+      seats[op->winner_to[1]] = id_2;
+      seats[op->loser_to[1]] = id_1;
+    }
+
+    // Update ratings and RDs. The fast kernel works from the RDs alone, so
+    // the cached g(RD) and 1/RD^2 are only kept for the reference one.
+    if (update_ratings && fast_glicko) {
+      fast_glicko_update(rating[id_1], RD[id_1], rating[id_2], RD[id_2], s1, constants);
+    } else if (update_ratings) {
+      float g1, g2, E1, E2, x1, x2, y1, y2, RD_1, RD_2;
+      dif = rating[id_1] - rating[id_2];
+      g1 = g_RD[id_1];
+      g2 = g_RD[id_2];
+      E1 = 1. / (1. + pow(10., -g2 * dif / 400.));
+      E2 = 1. / (1. + pow(10.,  g1 * dif / 400.));
+      x1 = inv_RD_sq[id_1];
+      x2 = inv_RD_sq[id_2];
+      y1 = qs * square(g2) * E1 * (1. - E1);  // 1/(d^2)
+      y2 = qs * square(g1) * E2 * (1. - E2);  // 1/(d^2)
+      RD_1 = (std::max)(30., sqrt(1. / (x1 + y1)));
+      RD_2 = (std::max)(30., sqrt(1. / (x2 + y2)));
+      rating[id_1] += q * g2 * (s1 - E1) / (x1 + y1);
+      rating[id_2] += q * g1 * (s2 - E2) / (x2 + y2);
+      if (RD_1 != RD[id_1]) {
+        RD[id_1] = RD_1;
+        cache_RD(id_1);
+      }
+      if (RD_2 != RD[id_2]) {
+        RD[id_2] = RD_2;
+        cache_RD(id_2);
+      }
     }
-    // Place the players in losers bracket
-    if (i % 2 == 0) {
-      player_1 = player_library.find(name)->second;
+    results[k] = result;
+  }
+}
+
+// Find a match by side, round and index, as numbered in bracket_params.txt
+Match* Bracket::find_match(char side, int round_id, int index) {
+  std::vector<Round*>* rounds;
+  if (side == 'W')
+    rounds = &winners;
+  else if (side == 'L')
+    rounds = &losers;
+  else if (side == 'G')
+    rounds = &grands;
+  else
+    return NULL;
+  if (round_id < 0 || round_id >= rounds->size())
+    return NULL;
+  Round* round = (*rounds)[round_id];
+  if (index < 0 || index >= round->num_matches)
+    return NULL;
+  return round->matches[index];
+}
+
+// Return the address of a set in the bracket program, e.g. W3#5, as numbered
+// in bracket_params.txt
+std::string Bracket::match_address(int op) {
+  for (std::vector<Round*>* side : {&winners, &losers, &grands})
+    for (int i = 0; i < side->size(); i++)
+      for (int j = 0; j < (*side)[i]->num_matches; j++)
+        if ((*side)[i]->matches[j]->op == op)
+          return (*side)[i]->side + std::to_string(i) + "#" + std::to_string(j);
+  return "";
+}
+
+// Parse a result given as e.g. "W3#5 = 2", returning the index of the set in
+// the bracket program, or -1 if the text does not name a set with a valid
+// result (1 or 2, or 0 for no result)
+int Bracket::parse_result(const std::string& text, int& result) {
+  char side;
+  int round_id, index, end = 0;
+  if (sscanf(text.c_str(), " %c%d #%d = %d %n", &side, &round_id, &index, &result, &end) < 4 ||
+      end != text.size() || result < 0 || result > 2)
+    return -1;
+  Match* match = find_match(side, round_id, index);
+  return match == NULL ? -1 : match->op;
+}
+
+// Parse a comma-separated list of sets, each given as e.g. W3#5, or as a whole
+// round, e.g. W3, or as "pending" for every set ready to be played. Returns the
+// indices of the sets in the bracket program, or an empty list on error.
+std::vector<int> Bracket::parse_sets(const std::string& text) {
+  std::vector<int> ops;
+  std::vector<int> occupants = known_occupants();
+  std::istringstream iss(text);
+  std::string item;
+  while (std::getline(iss, item, ',')) {
+    char side;
+    int round_id, index, end = 0;
+    if (item == "pending") {
+      for (int k = 0; k < program.size(); k++)
+        if (is_pending(k, occupants))
+          ops.push_back(k);
+    } else if (sscanf(item.c_str(), " %c%d #%d %n", &side, &round_id, &index, &end) == 3 &&
+               end == item.size()) {
+      Match* match = find_match(side, round_id, index);
+      if (match == NULL || match->op < 0)
+        return std::vector<int>();
+      ops.push_back(match->op);
+    } else if (sscanf(item.c_str(), " %c%d %n", &side, &round_id, &end) == 2 &&
+               end == item.size()) {
+      if (find_match(side, round_id, 0) == NULL)
+        return std::vector<int>();
+      for (int i = 0; find_match(side, round_id, i) != NULL; i++)
+        if (find_match(side, round_id, i)->op >= 0)
+          ops.push_back(find_match(side, round_id, i)->op);
     } else {
-      player_2 = player_library.find(name)->second;
-      losers.back()->matches[i / 2]->set_players(player_1, player_2);
-      players_in_bracket.push_back(player_1);
-      players_in_bracket.push_back(player_2);
+      return std::vector<int>();
     }
-    i++;
   }
+  return ops;
 }
 
-// Set the results of the matches in a bracket that are already known
-void Bracket::set_res_fixed(std::vector<std::vector<int>> res_fixed_W,
-                            std::vector<std::vector<int>> res_fixed_L,
-                            std::vector<std::vector<int>> res_fixed_G) {
-  for (int i = 0; i < res_fixed_W.size(); i++)
-    winners[i]->set_res_fixed(res_fixed_W[i]);
-  for (int i = 0; i < res_fixed_L.size(); i++)
-    losers[i]->set_res_fixed(res_fixed_L[i]);
-  for (int i = 0; i < res_fixed_G.size(); i++)
-    grands[i]->set_res_fixed(res_fixed_G[i]);
+// Find which player is certain to occupy each seat given the results already
+// known, or -1 where it depends on sets still to be played
+std::vector<int> Bracket::known_occupants() {
+  std::vector<int> occupants(seats.size(), -1);
+  std::vector<bool> written(seats.size(), false);
+  for (int k = 0; k < program.size(); k++)
+    for (int r = 0; r < 2; r++) {
+      written[program[k].winner_to[r]] = true;
+      written[program[k].loser_to[r]] = true;
+    }
+  for (int s = 0; s < seats.size(); s++)
+    if (!written[s])
+      occupants[s] = seats[s];
+
+  int result = 0;
+  for (int k = 0; k < program.size(); k++) {
+    const MatchOp& op = program[k];
+    if (op.conditional && result != 2)
+      break;
+    result = op.result_fixed;
+    int id_1 = occupants[op.seat];
+    int id_2 = occupants[op.seat + 1];
+    if (result == 0 || id_1 < 0 || id_2 < 0)
+      continue;
+    occupants[op.winner_to[result - 1]] = result == 1 ? id_1 : id_2;
+    occupants[op.loser_to[result - 1]] = result == 1 ? id_2 : id_1;
+  }
+  return occupants;
 }
 
-// Update player results (post-simulation)
-void Bracket::update_player_results() {
-  // 1st-4th place: 1 player each
-  for (int i = 0; i < 4; i++) {
-    placings[i]->matches[0]->player_1->placings[i] += 1;
-  }
-  // 5th place and on: multiple players each
-  for (int i = 4; i < num_rounds_P; i++) {
-    for (std::vector<Match*>::iterator it = placings[i]->matches.begin();
-         it != placings[i]->matches.end(); it++) {
-      (*it)->player_1->placings[i] += 1;
-      (*it)->player_2->placings[i] += 1;
+// Return whether a set is next to be played: its result is not known but both
+// its players are, and it is certain to be played
+bool Bracket::is_pending(int k, const std::vector<int>& occupants) {
+  const MatchOp& op = program[k];
+  return op.result_fixed == 0 && occupants[op.seat] >= 0 && occupants[op.seat + 1] >= 0 &&
+         (!op.conditional || program[k - 1].result_fixed == 2);
+}
+
+// Print the placings of every player, sorted by average points
+void print_results(std::vector<Player*> players_in_bracket, int num_placings, FILE* out) {
+  std::sort(players_in_bracket.begin(), players_in_bracket.end(), by_avg_points());
+  fprintf(out, "  %-16s%9s", "Name", "Points");
+  for (int i = 0; i < num_placings; i++)
+    fprintf(out, "%9s", get_ordinal(get_placing(i)).c_str());
+  fprintf(out, "\n");
+  fprintf(out, "  %s\n", std::string(25 + 9 * num_placings, '-').c_str());
+  for (std::vector<Player*>::iterator it = players_in_bracket.begin();
+       it != players_in_bracket.end(); it++) {
+    fprintf(out, "  %-16s  %7.2f", (*it)->name.c_str(), (*it)->avg_points);
+    for (int i = 0; i < num_placings; i++) {
+      fprintf(out, "  %7" PRId64, (*it)->placings[i]);
+    }
+    fprintf(out, "\n");
+  }
+  fprintf(out, "\n");
+}
+
+// Print the confidence intervals of every player's average points and placing
+// probabilities, in the same order as print_results
+void print_intervals(std::vector<Player*> players_in_bracket, int num_placings, FILE* out) {
+  std::sort(players_in_bracket.begin(), players_in_bracket.end(), by_avg_points());
+  fprintf(out, "  95%% confidence intervals (+/- points, +/- percentage points)\n");
+  fprintf(out, "  %-16s%9s", "Name", "Points");
+  for (int i = 0; i < num_placings; i++)
+    fprintf(out, "%9s", get_ordinal(get_placing(i)).c_str());
+  fprintf(out, "\n");
+  fprintf(out, "  %s\n", std::string(25 + 9 * num_placings, '-').c_str());
+  for (std::vector<Player*>::iterator it = players_in_bracket.begin();
+       it != players_in_bracket.end(); it++) {
+    fprintf(out, "  %-16s  %7.3f", (*it)->name.c_str(), (*it)->avg_points_err);
+    for (int i = 0; i < num_placings; i++) {
+      fprintf(out, "  %7.3f", (*it)->placings_err[i]);
     }
+    fprintf(out, "\n");
   }
+  fprintf(out, "\n");
 }
 
-// Simulate the full bracket
-void Bracket::simulate() {
-  reset_players(player_library);
-  for (std::vector<Round*>::reverse_iterator it = winners.rbegin();
-       it != winners.rend(); it++)
-    (*it)->simulate();
-  for (std::vector<Round*>::reverse_iterator it = losers.rbegin();
-       it != losers.rend(); it++)
-    (*it)->simulate();
-  grands[1]->simulate();
-  if (grands[1]->matches[0]->bracket_reset)
-    grands[0]->simulate();
+// Print the importance-sampled placing probabilities of the target player,
+// with their standard errors, from n simulations. Every simulation gives the
+// target exactly one placing, so the spread of the points and the effective
+// sample size follow from the sums over each placing.
+void print_target_results(Bracket* bracket, int64_t n, FILE* out) {
+  int num_placings = bracket->num_rounds_P;
+  const double* w = &bracket->weighted_placings[bracket->target * num_placings];
+  const double* w_sq = &bracket->weighted_placings_sq[bracket->target * num_placings];
+  double sum = 0., sum_sq = 0., points = 0., points_sq = 0., p = 100.;
 
-  update_player_results();
+  fprintf(out, "  %-9s%14s%14s%11s\n", "Placing", "Probability", "Std error", "Rel error");
+  fprintf(out, "  %s\n", std::string(48, '-').c_str());
+  for (int j = 0; j < bracket->num_rounds_P; j++) {
+    double prob = w[j] / n;
+    double err = sqrt((std::max)(0., w_sq[j] / n - prob * prob) / n);
+    fprintf(out, "  %-9s%14.4e%14.4e", get_ordinal(get_placing(j)).c_str(), prob, err);
+    if (prob > 0.)
+      fprintf(out, "%10.2f%%\n", 100. * err / prob);
+    else
+      fprintf(out, "%11s\n", "-");
+    sum += w[j];
+    sum_sq += w_sq[j];
+    points += w[j] * p;
+    points_sq += w_sq[j] * p * p;
+    p *= 0.75;
+  }
+  points /= n;
+  double err = sqrt((std::max)(0., points_sq / n - points * points) / n);
+  fprintf(out, "  %-9s%14.4f%14.4f\n", "Points", points, err);
+  fprintf(out, "\n");
+  fprintf(out, "Effective sample size: %.0f of %" PRId64 " simulations\n", sum * sum / sum_sq, n);
+}
+
+// Add the blocks of every thread into thread 0's, clearing the others. The
+// reduction is split into whole cache lines of the blocks, each summed over
+// the threads in order, so that the result does not depend on the split.
+template <typename T>
+void reduce_blocks(const std::vector<T*>& blocks, int size) {
+  int per_line = CACHE_LINE / sizeof(T);
+  int num_lines = (size + per_line - 1) / per_line;
+  #pragma omp parallel for schedule(static)
+  for (int c = 0; c < num_lines; c++) {
+    int end = (std::min)(size, (c + 1) * per_line);
+    for (int t = 1; t < blocks.size(); t++)
+      for (int x = c * per_line; x < end; x++) {
+        blocks[0][x] += blocks[t][x];
+        blocks[t][x] = 0;
+      }
+  }
+}
+
+// Add the placings counted by every thread into those of thread 0's players,
+// clearing the counts so that the merge can be repeated after every batch
+void merge_placings(std::vector<Bracket*>& brackets) {
+  Bracket* bracket = brackets[0];
+  int num_placings = bracket->num_rounds_P;
+  std::vector<int64_t*> counts;
+  for (int t = 0; t < brackets.size(); t++)
+    counts.push_back(brackets[t]->placing_counts);
+  reduce_blocks(counts, bracket->num_players * num_placings);
+  for (int i = 0; i < bracket->num_players; i++) {
+    Player* player = bracket->players_in_bracket[i];
+    for (int p = 0; p < num_placings; p++) {
+      player->placings[p] += counts[0][i * num_placings + p];
+      counts[0][i * num_placings + p] = 0;
+    }
+    player->calc_avg_points();
+  }
+
+  if (bracket->target >= 0) {
+    std::vector<double*> weighted, weighted_sq;
+    for (int t = 0; t < brackets.size(); t++) {
+      weighted.push_back(brackets[t]->weighted_placings);
+      weighted_sq.push_back(brackets[t]->weighted_placings_sq);
+    }
+    reduce_blocks(weighted, bracket->num_players * num_placings);
+    reduce_blocks(weighted_sq, bracket->num_players * num_placings);
+  }
+
+  if (!bracket->strata.empty()) {
+    std::vector<int64_t*> strata_counts;
+    for (int t = 0; t < brackets.size(); t++)
+      strata_counts.push_back(brackets[t]->strata_placings);
+    reduce_blocks(strata_counts, bracket->num_players * bracket->num_strata_placings *
+                                 bracket->strata.size() * 2);
+  }
 }
@@ -2,8 +2,12 @@
 #define BRACKET_H
 
 #include <algorithm>
+#include <atomic>
 #include <cassert>
+#include <cinttypes>
+#include <climits>
 #include <cmath>
+#include <cstring>
 #include <fstream>
 #include <iomanip>
 #include <iostream>
@@ -14,6 +18,8 @@
 #include <vector>
 
 #include "math.h"
+#include "Glicko.hpp"
+#include "Random.hpp"
 
 // OpenMP
 #ifdef _OPENMP
@@ -28,6 +34,14 @@
 #include <windows.h>
 #endif
 
+// Memory-mapped ratings files
+#ifdef __linux__
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
 // Output color and formatting
 #if defined _WIN32
 #define IRED 12
@@ -43,8 +57,19 @@
 #define BOLD(x) x
 #endif
 
+// Largest field for which the pairwise win probabilities are tabulated
+#define MAX_WIN_PROB_TABLE 2048
+
+// Size of a cache line. Counters written by different threads are kept on
+// lines of their own, so that no two threads ever write to the same one.
+#define CACHE_LINE 64
+
+// Name marking an empty seat in initial_bracket.txt
+#define BYE "BYE"
+
 extern float pi, q, qs;
 extern bool update_ratings;
+extern bool fast_glicko;
 
 #ifdef _WIN32
 int get_console_color();
@@ -54,10 +79,27 @@ void print_status_msg(int, std::string);
 void throw_error(std::string);
 void throw_warning(std::string);
 
-float rand_float();
 float square(float);
+float win_probability(float, float, float, float);
 int int_power(int, int);
+
+// Size a buffer to hold a zeroed block of the given number of elements that
+// starts on a cache line and fills whole lines, and return the block
+template <typename T>
+T* cache_aligned(std::vector<T>& buffer, size_t size) {
+  size_t per_line = CACHE_LINE / sizeof(T);
+  buffer.assign((size + per_line - 1) / per_line * per_line + per_line, 0);
+  uintptr_t address = (uintptr_t) buffer.data();
+  return (T*) ((address + CACHE_LINE - 1) / CACHE_LINE * CACHE_LINE);
+}
+
+// Counter on a cache line of its own, for one thread to write and any to read
+struct alignas(CACHE_LINE) PaddedCount {
+  std::atomic<int64_t> count{0};
+};
+
 std::string get_ordinal(int);
+int get_placing(int);
 
 std::ifstream open_file(std::string);
 
@@ -67,32 +109,92 @@ void load_bracket_params(int&, int&,
                          std::vector<std::vector<int>>&,
                          std::vector<std::vector<int>>&,
                          std::vector<std::vector<int>>&,
-                         std::vector<std::vector<int>>&);
+                         std::vector<std::vector<int>>&, std::string = "");
 
-void load_initial_players(std::vector<std::string>&, std::vector<std::string>&);
+void load_initial_players(std::vector<std::string>&, std::vector<std::string>&,
+                          std::string = "");
 
 class Player {
  public:
   std::string name;
   float rating, RD;
   float rating_orig, RD_orig;
-  std::vector<int> placings;
+  std::vector<int64_t> placings;
   float avg_points;
+  std::vector<float> placings_err;  // confidence interval half-widths, in %
+  float avg_points_err;
 
   Player(std::string, float, float);  // constructor
   Player(const Player&);  // copy constructor
   void reset_rating();
   void update_orig_rating();
   void calc_avg_points();
+  void calc_intervals(float);
 };
 
-typedef std::map<std::string, Player*> playerLibrary;
+// Smallest hash table of a player database
+#define MIN_PLAYER_INDEX 1024
+
+// Binary ratings file, converted from player_data.txt by convert_ratings
+#define RATINGS_FILE "player_data.bin"
+#define RATINGS_MAGIC "RATINGS"
+#define RATINGS_VERSION 1
+
+struct RatingsHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t num_players;
+  uint32_t num_slots;   // Of the hash table
+  uint32_t names_size;  // Bytes in the string table
+  uint64_t file_size;
+};
+
+// Every player's name, original rating and RD, by player ID, with a hash
+// table (open addressing, FNV-1a) to look up IDs by name. It is shared by all
+// threads, which copy only the players in their bracket. The arrays are laid
+// out as in the binary ratings file, so a database can be read straight from
+// a mapped file without parsing; otherwise they point into its own storage.
+class PlayerDatabase {
+ public:
+  const float* rating_orig;
+  const float* RD_orig;
+
+  PlayerDatabase();
+  ~PlayerDatabase();
+  PlayerDatabase(const PlayerDatabase&) = delete;
+  PlayerDatabase& operator=(const PlayerDatabase&) = delete;
+  std::string name(int) const;
+  int find(const std::string&) const;
+  int add(const std::string&, float, float);
+  void save(std::string) const;
+  bool map(std::string);
+  int size() const {
+    return num_players;
+  }
+
+ private:
+  int num_players;
+  int num_slots;
+  const uint32_t* name_offsets;  // [ID], then the end of the last name
+  const char* name_data;
+  const int32_t* index;  // Player ID in each slot of the hash table, -1 when empty
 
-playerLibrary load_player_data();
+  std::vector<float> own_rating, own_RD;
+  std::vector<uint32_t> own_offsets;
+  std::vector<char> own_names;
+  std::vector<int32_t> own_index;
+  void* mapping;
+  size_t mapping_size;
 
-playerLibrary copy_player_library(const playerLibrary&);
+  static uint64_t hash(const char*, int);
+  void insert(int);
+  void rehash(int);
+  void point_to_own();
+  void copy_mapping();
+  void unmap();
+};
 
-void reset_players(playerLibrary);
+void load_player_data(PlayerDatabase&, bool = true);
 
 struct by_avg_points {
   bool operator()(Player* p1, Player* p2) {
@@ -106,19 +208,15 @@ class Match {
   char side;
   int round_id;
   int index;
-  Player* player_1, *player_2;
+  int seat;  // Program seat of player 1; player 2 sits at seat + 1
+  int op;    // Index of the match in the bracket program (-1 for placings)
   Match* winner_to, *loser_to;
   int wt_index, lt_index;
-  int result, result_fixed;
-  Player* winner, *loser;
 
   Match(std::string, char, int, int); // constructor
   void set_structure(Match*, int, Match*, int);
-  void set_players(Player*, Player*);
-  void simulate();
 
   // Used for GF1 only
-  bool bracket_reset;
   Match* wside_winner_to, *wside_loser_to, *lside_winner_to, *lside_loser_to;
   int wside_wt_index, wside_lt_index, lside_wt_index, lside_lt_index;
   void set_structure_gf1(Match*, int, Match*, int, Match*, int, Match*, int);
@@ -133,28 +231,121 @@ class Round {
   std::vector<Match*> matches;
 
   Round(char, int);
-  void set_res_fixed(std::vector<int>);
-  void simulate();
+  ~Round();
+};
+
+// A set in the compiled bracket program. Seats hold player IDs (indices into
+// Bracket::players_in_bracket); the players of a set sit in seats `seat` and
+// `seat + 1`, and the winner and loser are written to the seats of their next
+// sets, indexed by result - 1.
+struct MatchOp {
+  int seat;
+  int winner_to[2], loser_to[2];
+  int result_fixed;
+  bool conditional;  // Only played if player 2 won the previous set (GF2)
+};
+
+// A seat whose occupant finishes in the given placing
+struct PlacingSeat {
+  int seat;
+  int placing;
 };
 
 class Bracket {
  public:
   int num_W, num_L;
-  playerLibrary player_library;
+  const PlayerDatabase* database;
   int num_rounds_W, num_rounds_L, num_rounds_G, num_rounds_P;
   std::vector<Player*> players_in_bracket;
   std::vector<Round*> winners, losers, grands, placings;
 
+  // Bracket program, in execution order
+  std::vector<MatchOp> program;
+  std::vector<int> seats;
+  std::vector<PlacingSeat> placing_seats;
+  std::vector<int> results;  // Result of each set in the last simulation
+
+  // Placings of the simulations run by this bracket's thread since the last
+  // merge, [player * num_rounds_P + placing], on cache lines of their own
+  int64_t* placing_counts;
+  std::vector<int> initial_seats_W, initial_seats_L;  // In initial_bracket.txt order; -1 for byes
+
+  // Placings stratified by the results of selected sets,
+  // [((player * num_strata_placings + placing) * 2 + result - 1) * strata.size() + set],
+  // on cache lines of their own
+  std::vector<int> strata;
+  int64_t* strata_placings;
+  int num_strata_placings;
+
+  // Importance sampling toward a target player: the likelihood ratio of the
+  // current simulation, and the sums of the ratios and their squares over the
+  // simulations ending in each placing, [player * num_placings + placing], on
+  // cache lines of their own
+  int target;
+  float tilt;
+  double weight;
+  double* weighted_placings, *weighted_placings_sq;
+
+  // Lookup tables indexed by player ID
+  int num_players;
+  std::vector<float> win_prob;  // [id_1 * num_players + id_2]; static ratings only
+
+  // Live state of the players during a simulation: rating, RD, g(RD) and
+  // 1/RD^2, as four arrays in one block (live), which is restored from its
+  // snapshot at the original ratings (live_orig) by a single memcpy at the
+  // start of each simulation. The pointers index into the blocks by player ID.
+  float* rating, *RD, *g_RD, *inv_RD_sq;
+  float* rating_orig, *RD_orig;
+
   Bracket(int, int);
-  void set_player_library(playerLibrary);
-  void set_structure(std::vector<std::vector<int>>);
-  void set_initial_players(std::vector<std::string>,
-                           std::vector<std::string>, int);
-  void set_res_fixed(std::vector<std::vector<int>>,
-                     std::vector<std::vector<int>>,
-                     std::vector<std::vector<int>>);
+  ~Bracket();
+  Bracket(const Bracket&) = delete;
+  Bracket& operator=(const Bracket&) = delete;
+  void set_player_database(const PlayerDatabase*);
+  void set_structure(const std::vector<std::vector<int>>&);
+  void set_initial_players(const std::vector<std::string>&,
+                           const std::vector<std::string>&, int);
+  void set_res_fixed(const std::vector<std::vector<int>>&,
+                     const std::vector<std::vector<int>>&,
+                     const std::vector<std::vector<int>>&);
+  void reload_ratings();
   void update_player_results();
-  void simulate();
+  void clear_placings();
+  void set_strata(const std::vector<int>&);
+  void update_strata(const int*, const int*, int);
+  void set_target(int, float);
+  void simulate(const RandomStream&);
+  void play(const RandomStream&);
+  Match* find_match(char, int, int);
+  std::string match_address(int);
+  int parse_result(const std::string&, int&);
+  std::vector<int> parse_sets(const std::string&);
+  std::vector<int> known_occupants();
+  bool is_pending(int, const std::vector<int>&);
+
+ private:
+  std::vector<float> live, live_orig;
+  std::vector<int64_t> placing_buffer, strata_buffer;
+  std::vector<double> weighted_buffer, weighted_sq_buffer;
+  std::vector<int> strata_index;
+  std::vector<bool> bye_seats;  // Initial seats left empty
+  std::vector<int> redirect;    // Seat a player skips to through a set with a bye, or -1
+
+  void compile_program();
+  int resolve_seat(int);
+  void build_tables();
+  void cache_RD(int);
+  void set_round_res_fixed(std::vector<Round*>&,
+                           const std::vector<std::vector<int>>&);
+  int place_player(const std::string&, int);
 };
 
+void print_results(std::vector<Player*>, int, FILE* = stdout);
+
+void print_intervals(std::vector<Player*>, int, FILE* = stdout);
+
+void print_target_results(Bracket*, int64_t, FILE* = stdout);
+
+void merge_placings(std::vector<Bracket*>&);
+
 #endif
@@ -0,0 +1,94 @@
+#include "Checkpoint.hpp"
+
+// Add bytes to an FNV-1a hash
+static void hash_bytes(uint64_t& h, const void* data, size_t size) {
+  const unsigned char* bytes = (const unsigned char*) data;
+  for (size_t i = 0; i < size; i++) {
+    h ^= bytes[i];
+    h *= 0x100000001B3ULL;
+  }
+}
+
+// Return a hash of everything the simulations of a bracket depend on. Only
+// whole ints and floats are hashed, never padding.
+uint64_t input_hash(Bracket* bracket) {
+  uint64_t h = 0xCBF29CE484222325ULL;
+  for (int k = 0; k < bracket->program.size(); k++) {
+    const MatchOp& op = bracket->program[k];
+    int fields[7] = {op.seat, op.winner_to[0], op.winner_to[1], op.loser_to[0], op.loser_to[1],
+                     op.result_fixed, op.conditional};
+    hash_bytes(h, fields, sizeof(fields));
+  }
+  hash_bytes(h, bracket->initial_seats_W.data(), bracket->initial_seats_W.size() * sizeof(int));
+  hash_bytes(h, bracket->initial_seats_L.data(), bracket->initial_seats_L.size() * sizeof(int));
+  for (int s = 0; s < bracket->placing_seats.size(); s++) {
+    int fields[2] = {bracket->placing_seats[s].seat, bracket->placing_seats[s].placing};
+    hash_bytes(h, fields, sizeof(fields));
+  }
+  for (int i = 0; i < bracket->num_players; i++) {
+    const Player* player = bracket->players_in_bracket[i];
+    hash_bytes(h, player->name.c_str(), player->name.size() + 1);
+    hash_bytes(h, &player->rating_orig, sizeof(float));
+    hash_bytes(h, &player->RD_orig, sizeof(float));
+  }
+  return h;
+}
+
+// Write the placing counts merged into the players of a bracket, from the
+// first num_run of n simulations with the given seed, as a checkpoint. The
+// file is written in full under a temporary name and then renamed over the
+// old one, so a run stopped while writing leaves the last checkpoint intact.
+void save_checkpoint(std::string fname, Bracket* bracket, uint32_t flags, uint64_t seed,
+                     int64_t n, int64_t num_run) {
+  CheckpointHeader header;
+  memcpy(header.magic, CHECKPOINT_MAGIC, sizeof(header.magic));
+  header.version = CHECKPOINT_VERSION;
+  header.flags = flags;
+  header.input_hash = input_hash(bracket);
+  header.seed = seed;
+  header.n = n;
+  header.num_run = num_run;
+  header.num_players = bracket->num_players;
+  header.num_placings = bracket->num_rounds_P;
+
+  std::string temp = fname + ".tmp";
+  FILE* out = fopen(temp.c_str(), "wb");
+  if (out == NULL)
+    throw_error("Unable to write " + temp);
+  bool ok = fwrite(&header, sizeof(header), 1, out) == 1;
+  for (int i = 0; i < bracket->num_players; i++)
+    ok = ok && fwrite(bracket->players_in_bracket[i]->placings.data(), sizeof(int64_t),
+                      header.num_placings, out) == header.num_placings;
+  if (fclose(out) != 0 || !ok || rename(temp.c_str(), fname.c_str()) != 0)
+    throw_error("Unable to write " + fname);
+}
+
+// Read a checkpoint
+Checkpoint load_checkpoint(std::string fname) {
+  FILE* in = fopen(fname.c_str(), "rb");
+  if (in == NULL)
+    throw_error("Unable to open " + fname);
+  Checkpoint checkpoint;
+  CheckpointHeader& header = checkpoint.header;
+  if (fread(&header, sizeof(header), 1, in) != 1 ||
+      memcmp(header.magic, CHECKPOINT_MAGIC, sizeof(header.magic)) != 0)
+    throw_error(fname + " is not a checkpoint file");
+  if (header.version != CHECKPOINT_VERSION)
+    throw_error(fname + " is a checkpoint file of version " + std::to_string(header.version) +
+                ", expected " + std::to_string(CHECKPOINT_VERSION));
+  checkpoint.counts.resize((size_t) header.num_players * header.num_placings);
+  if (fread(checkpoint.counts.data(), sizeof(int64_t), checkpoint.counts.size(), in) !=
+      checkpoint.counts.size() || fgetc(in) != EOF)
+    throw_error(fname + " is truncated or corrupt");
+  fclose(in);
+  return checkpoint;
+}
+
+// Check that a checkpoint read from fname was made from the same inputs as
+// the bracket
+void check_inputs(const Checkpoint& checkpoint, Bracket* bracket, std::string fname) {
+  if (checkpoint.header.input_hash != input_hash(bracket) ||
+      checkpoint.header.num_players != bracket->num_players ||
+      checkpoint.header.num_placings != bracket->num_rounds_P)
+    throw_error(fname + " was made from a different bracket, results or player data");
+}
@@ -0,0 +1,49 @@
+#ifndef CHECKPOINT_H
+#define CHECKPOINT_H
+
+#include "Bracket.hpp"
+
+// Default seconds between two checkpoints
+#define CHECKPOINT_INTERVAL 60
+
+// Checkpoint file, written with --checkpoint, read back with --resume and
+// combined with others by merge_results: the header, then the placing counts
+// of every player, [player * num_placings + placing], as int64, by player ID
+// in the bracket. A run's final checkpoint is its result file.
+//
+// The random numbers of simulation i depend only on the seed and i, so the
+// seed and the number of simulations counted so far (always 0 to num_run - 1)
+// are all the state a run needs to carry on from. The input hash covers
+// everything the simulations depend on: the bracket, the results already
+// fixed, the initial seats and the players' names, ratings and RDs.
+#define CHECKPOINT_MAGIC "BRCHKPT"
+#define CHECKPOINT_VERSION 1
+
+// Flags of the options a run was made with
+#define CHECKPOINT_SIMD 1         // --engine simd
+#define CHECKPOINT_STATIC 2       // --static-ratings
+#define CHECKPOINT_FAST_GLICKO 4  // --fast-glicko
+
+struct CheckpointHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t flags;
+  uint64_t input_hash;
+  uint64_t seed;
+  int64_t n;        // Simulations the run was asked for
+  int64_t num_run;  // Simulations counted
+  uint32_t num_players;
+  uint32_t num_placings;
+};
+
+struct Checkpoint {
+  CheckpointHeader header;
+  std::vector<int64_t> counts;
+};
+
+uint64_t input_hash(Bracket*);
+void save_checkpoint(std::string, Bracket*, uint32_t, uint64_t, int64_t, int64_t);
+Checkpoint load_checkpoint(std::string);
+void check_inputs(const Checkpoint&, Bracket*, std::string);
+
+#endif
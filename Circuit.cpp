@@ -0,0 +1,164 @@
+#include "Circuit.hpp"
+
+// Circuit constructor. The file lists the directory of each event in order,
+// one per line, each with its own bracket_params.txt and initial_bracket.txt;
+// every event draws on the ratings in player_data.txt.
+Circuit::Circuit(std::string fname, int num_threads) {
+  std::ifstream infile = open_file(fname);
+  std::string line;
+  while (std::getline(infile, line)) {
+    line.erase(0, line.find_first_not_of(" \t\r"));
+    line.erase(line.find_last_not_of(" \t\r") + 1);
+    if (line.empty() || line[0] == '#')
+      continue;
+    if (line.back() != '/')
+      line += "/";
+    events.push_back(line);
+  }
+  if (events.empty())
+    throw_error("No events found in " + fname);
+
+  load_player_data(database);
+
+  // Build every event's bracket for each thread
+  brackets.resize(events.size());
+  season_ids.resize(events.size());
+  for (int e = 0; e < events.size(); e++) {
+    int num_W, num_L;
+    std::vector<std::vector<int>> wl_map, res_fixed_W, res_fixed_L, res_fixed_G;
+    load_bracket_params(num_W, num_L, wl_map, res_fixed_W, res_fixed_L, res_fixed_G,
+                        events[e]);
+    std::vector<std::string> players_W, players_L;
+    load_initial_players(players_W, players_L, events[e]);
+
+    brackets[e].resize(num_threads);
+    for (int t = 0; t < num_threads; t++) {
+      brackets[e][t] = new Bracket(num_W, num_L);
+      brackets[e][t]->set_player_database(&database);
+      brackets[e][t]->set_structure(wl_map);
+      brackets[e][t]->set_initial_players(players_W, players_L, t);
+      brackets[e][t]->set_res_fixed(res_fixed_W, res_fixed_L, res_fixed_G);
+    }
+
+    // Players new to the season start from their rating in this event, which
+    // is the default one if they are not in the database
+    std::vector<Player*>& players = brackets[e][0]->players_in_bracket;
+    for (int i = 0; i < players.size(); i++) {
+      int s = season.add(players[i]->name, players[i]->rating_orig, players[i]->RD_orig);
+      if (s == num_entered.size())
+        num_entered.push_back(0);
+      season_ids[e].push_back(s);
+      num_entered[s]++;
+    }
+  }
+
+  int num_placings = 0;
+  for (int e = 0; e < events.size(); e++)
+    num_placings = (std::max)(num_placings, brackets[e][0]->num_rounds_P);
+  float p = 100.;
+  for (int j = 0; j < num_placings; j++) {
+    placing_points.push_back(p);
+    p *= 0.75;
+  }
+
+  rating.assign(num_threads, std::vector<float>(season.size()));
+  RD.assign(num_threads, std::vector<float>(season.size()));
+  points.assign(num_threads, std::vector<float>(season.size()));
+  order.assign(num_threads, std::vector<int>(season.size()));
+  points_sum.assign(num_threads, std::vector<double>(season.size(), 0.));
+  rank_counts.assign(num_threads, std::vector<int64_t>(season.size() * SEASON_RANKS, 0));
+}
+
+struct by_points {
+  const float* points;
+  bool operator()(int i, int j) {
+    return points[i] > points[j];
+  }
+};
+
+// Simulate one draw of the whole season on thread t. Event e of the draw uses
+// the random stream of simulation draw * (number of events) + e.
+void Circuit::simulate(int t, uint64_t seed, uint64_t draw) {
+  int num_players = season.size();
+  float* season_points = points[t].data();
+  float* live_rating = rating[t].data();
+  float* live_RD = RD[t].data();
+  std::copy(season.rating_orig, season.rating_orig + num_players, live_rating);
+  std::copy(season.RD_orig, season.RD_orig + num_players, live_RD);
+  std::fill(season_points, season_points + num_players, 0.f);
+
+  for (int e = 0; e < events.size(); e++) {
+    Bracket* bracket = brackets[e][t];
+    const int* ids = season_ids[e].data();
+
+    // Start the event from the ratings the players ended their last one with
+    for (int i = 0; i < bracket->num_players; i++) {
+      bracket->rating_orig[i] = live_rating[ids[i]];
+      bracket->RD_orig[i] = live_RD[ids[i]];
+    }
+    bracket->reload_ratings();
+
+    bracket->play(RandomStream(seed, draw * events.size() + e));
+    for (std::vector<PlacingSeat>::iterator it = bracket->placing_seats.begin();
+         it != bracket->placing_seats.end(); it++)
+      season_points[ids[bracket->seats[it->seat]]] += placing_points[it->placing];
+    for (int i = 0; i < bracket->num_players; i++) {
+      live_rating[ids[i]] = bracket->rating[i];
+      live_RD[ids[i]] = bracket->RD[i];
+    }
+  }
+
+  // Standings, with tied players sharing the higher rank
+  std::vector<int>& standings = order[t];
+  for (int s = 0; s < num_players; s++) {
+    points_sum[t][s] += season_points[s];
+    standings[s] = s;
+  }
+  by_points cmp = {season_points};
+  int num_ranked = (std::min)(SEASON_RANKS, (int) standings.size());
+  std::partial_sort(standings.begin(), standings.begin() + num_ranked, standings.end(), cmp);
+  int rank = 0;
+  for (int r = 0; r < num_ranked; r++) {
+    if (r > 0 && season_points[standings[r]] < season_points[standings[r - 1]])
+      rank = r;
+    rank_counts[t][standings[r] * SEASON_RANKS + rank]++;
+  }
+  for (int r = num_ranked; r < standings.size(); r++)
+    if (season_points[standings[r]] == season_points[standings[num_ranked - 1]])
+      rank_counts[t][standings[r] * SEASON_RANKS + rank]++;
+}
+
+// Merge the threads' totals and print each player's expected season points
+// and the number of times they finished in each of the top standings, out of
+// n draws
+void Circuit::print(int64_t n) {
+  for (int t = 1; t < points_sum.size(); t++) {
+    for (int s = 0; s < season.size(); s++)
+      points_sum[0][s] += points_sum[t][s];
+    for (int x = 0; x < rank_counts[0].size(); x++)
+      rank_counts[0][x] += rank_counts[t][x];
+  }
+
+  std::vector<int>& standings = order[0];
+  for (int s = 0; s < season.size(); s++) {
+    standings[s] = s;
+    points[0][s] = points_sum[0][s] / n;
+  }
+  by_points cmp = {points[0].data()};
+  std::stable_sort(standings.begin(), standings.end(), cmp);
+
+  int num_ranks = (std::min)(SEASON_RANKS, season.size());
+  printf("  %-16s%9s%9s", "Name", "Points", "Events");
+  for (int r = 0; r < num_ranks; r++)
+    printf("%9s", get_ordinal(r + 1).c_str());
+  printf("\n");
+  printf("  %s\n", std::string(34 + 9 * num_ranks, '-').c_str());
+  for (int i = 0; i < standings.size(); i++) {
+    int s = standings[i];
+    printf("  %-16s  %7.2f  %7d", season.name(s).c_str(), points[0][s], num_entered[s]);
+    for (int r = 0; r < num_ranks; r++)
+      printf("  %7" PRId64, rank_counts[0][s * SEASON_RANKS + r]);
+    printf("\n");
+  }
+  printf("\n");
+}
@@ -0,0 +1,48 @@
+#ifndef CIRCUIT_H
+#define CIRCUIT_H
+
+#include "Bracket.hpp"
+
+// Number of season standings whose probabilities are reported
+#define SEASON_RANKS 8
+
+// Circuit of events simulated in sequence within each draw. The ratings of
+// the players after one event are their original ratings in the next, so a
+// deep run early in the season makes the later ones more likely. Each thread
+// builds every event's bracket once and reuses them for every draw, keeping
+// the live ratings of the season's players in its own arrays; at the start of
+// a draw only those are reset, not the whole player database.
+class Circuit {
+ public:
+  std::vector<std::string> events;  // Directory of each event
+
+  Circuit(std::string, int);
+  void simulate(int, uint64_t, uint64_t);
+  void print(int64_t);
+  int num_players() {
+    return season.size();
+  }
+
+ private:
+  PlayerDatabase database;
+  std::vector<std::vector<Bracket*>> brackets;  // [event][thread]
+  std::vector<std::vector<int>> season_ids;      // [event][player ID in the bracket]
+
+  // Players entered in at least one event, by season ID, with their ratings
+  // at the start of the season
+  PlayerDatabase season;
+  std::vector<int> num_entered;
+  std::vector<std::vector<float>> rating, RD;  // [thread][season ID], during a draw
+
+  std::vector<float> placing_points;
+
+  // Per thread: season points of the current draw and the order of the
+  // standings, then the totals over all draws: points, and how often each
+  // player finished in each standing, [season ID * SEASON_RANKS + rank]
+  std::vector<std::vector<float>> points;
+  std::vector<std::vector<int>> order;
+  std::vector<std::vector<double>> points_sum;
+  std::vector<std::vector<int64_t>> rank_counts;
+};
+
+#endif
@@ -0,0 +1,187 @@
+#include "Exact.hpp"
+
+// Exact solver constructor
+ExactSolver::ExactSolver(Bracket* b) {
+  bracket = b;
+  num_players = bracket->players_in_bracket.size();
+  if (num_players >= EMPTY_SLOT)
+    throw_error("--exact supports at most " + std::to_string(EMPTY_SLOT - 1) + " players");
+  max_states = 0;
+}
+
+// Probability of player x beating player y, from the bracket's table when the
+// field is small enough to have one
+double ExactSolver::p_win(int x, int y) {
+  if (!bracket->win_prob.empty())
+    return bracket->win_prob[x * num_players + y];
+  return win_probability(bracket->rating_orig[x], bracket->RD_orig[x],
+                         bracket->rating_orig[y], bracket->RD_orig[y]);
+}
+
+// Choose the order of the sets and the slot of the state that holds each seat
+// in play. A set can be solved once both of its seats have been filled; of
+// those, sets that send a player to a placing seat go first, so that players
+// leave the state as early as possible. A seat holds its slot from the set
+// that fills it to the set that empties it, after which the slot is reused.
+void ExactSolver::plan() {
+  std::vector<MatchOp>& program = bracket->program;
+  int num_seats = bracket->seats.size();
+  placing_of.assign(num_seats, -1);
+  for (std::vector<PlacingSeat>::iterator ps = bracket->placing_seats.begin();
+       ps != bracket->placing_seats.end(); ps++)
+    placing_of[ps->seat] = ps->placing;
+
+  // Seats filled by a set (other than grand finals set 2's, which is solved
+  // together with set 1), and read by one
+  std::vector<bool> written(num_seats, false), read(num_seats, false);
+  for (int k = 0; k < program.size(); k++) {
+    if (program[k].conditional)
+      continue;
+    read[program[k].seat] = read[program[k].seat + 1] = true;
+    bool paired = k + 1 < program.size() && program[k + 1].conditional;
+    const MatchOp& last = paired ? program[k + 1] : program[k];
+    written[program[k].winner_to[0]] = written[program[k].loser_to[0]] = true;
+    for (int r = 0; r < 2; r++)
+      written[last.winner_to[r]] = written[last.loser_to[r]] = true;
+  }
+
+  order.clear();
+  slot.assign(num_seats, -1);
+  std::vector<bool> filled(num_seats, false), done(program.size(), false);
+  std::vector<int> free_slots;
+  num_slots = 0;
+  while (true) {
+    int best = -1;
+    for (int k = 0; k < program.size(); k++) {
+      const MatchOp& op = program[k];
+      if (done[k] || op.conditional ||
+          (written[op.seat] && !filled[op.seat]) ||
+          (written[op.seat + 1] && !filled[op.seat + 1]))
+        continue;
+      if (best < 0 ||
+          (placing_of[op.loser_to[0]] >= 0 && placing_of[program[best].loser_to[0]] < 0))
+        best = k;
+    }
+    if (best < 0)
+      break;
+    done[best] = true;
+    order.push_back(best);
+
+    const MatchOp& op = program[best];
+    for (int r = 0; r < 2; r++)
+      if (slot[op.seat + r] >= 0)
+        free_slots.push_back(slot[op.seat + r]);
+    bool paired = best + 1 < program.size() && program[best + 1].conditional;
+    std::vector<int> outputs = {op.winner_to[0], op.loser_to[0]};
+    const MatchOp& last = paired ? program[best + 1] : op;
+    for (int r = 0; r < 2; r++) {
+      outputs.push_back(last.winner_to[r]);
+      outputs.push_back(last.loser_to[r]);
+    }
+    for (int i = 0; i < outputs.size(); i++) {
+      int s = outputs[i];
+      if (filled[s])
+        continue;
+      filled[s] = true;
+      if (!read[s])
+        continue;
+      if (free_slots.empty()) {
+        slot[s] = num_slots++;
+      } else {
+        slot[s] = free_slots.back();
+        free_slots.pop_back();
+      }
+    }
+  }
+}
+
+// Player in a seat, in the given state
+int ExactSolver::occupant(const SeatState& state, int seat) {
+  return slot[seat] >= 0 ? state[slot[seat]] : bracket->seats[seat];
+}
+
+// Put a player in a seat: into the state if the seat is still to be played
+// from, or into their placings with the given probability if it is a placing
+// seat
+void ExactSolver::place(SeatState& state, int seat, int player, double mass) {
+  if (slot[seat] >= 0)
+    state[slot[seat]] = player;
+  else if (placing_of[seat] >= 0)
+    placings[player][placing_of[seat]] += mass;
+}
+
+// Carry the distribution of states through every set of the bracket
+void ExactSolver::solve() {
+  std::vector<MatchOp>& program = bracket->program;
+  plan();
+  placings.assign(num_players, std::vector<double>(bracket->num_rounds_P, 0.));
+
+  std::unordered_map<SeatState, double> states, next_states;
+  states[SeatState(num_slots, EMPTY_SLOT)] = 1.;
+  max_states = 1;
+  for (int i = 0; i < order.size(); i++) {
+    int k = order[i];
+    const MatchOp& op = program[k];
+
+    // A set that is only played if player 2 wins this one (GF2 after GF1) is
+    // played by the same pair, so it is resolved together with this set
+    const MatchOp* next = NULL;
+    if (k + 1 < program.size() && program[k + 1].conditional) {
+      next = &program[k + 1];
+      assert(op.winner_to[1] / 2 == next->seat / 2 && op.loser_to[1] / 2 == next->seat / 2);
+    }
+
+    next_states.clear();
+    for (std::unordered_map<SeatState, double>::iterator it = states.begin();
+         it != states.end(); it++) {
+      SeatState state = it->first;
+      double m = it->second;
+      int x = occupant(state, op.seat);
+      int y = occupant(state, op.seat + 1);
+      assert(x != y);
+      for (int r = 0; r < 2; r++)
+        if (slot[op.seat + r] >= 0)
+          state[slot[op.seat + r]] = EMPTY_SLOT;
+      double p1 = op.result_fixed == 0 ? p_win(x, y) : 2 - op.result_fixed;
+
+      // Player 1 wins
+      if (p1 > 0.) {
+        SeatState s = state;
+        place(s, op.winner_to[0], x, m * p1);
+        place(s, op.loser_to[0], y, m * p1);
+        next_states[s] += m * p1;
+      }
+
+      // Player 2 wins
+      if (p1 < 1. && next == NULL) {
+        SeatState s = state;
+        place(s, op.winner_to[1], y, m * (1. - p1));
+        place(s, op.loser_to[1], x, m * (1. - p1));
+        next_states[s] += m * (1. - p1);
+      } else if (p1 < 1.) {
+        int u = op.winner_to[1] == next->seat ? y : x;
+        int v = op.winner_to[1] == next->seat ? x : y;
+        double q1 = next->result_fixed == 0 ? p_win(u, v) : 2 - next->result_fixed;
+        double m_1 = m * (1. - p1) * q1, m_2 = m * (1. - p1) * (1. - q1);
+        if (q1 > 0.) {
+          SeatState s = state;
+          place(s, next->winner_to[0], u, m_1);
+          place(s, next->loser_to[0], v, m_1);
+          next_states[s] += m_1;
+        }
+        if (q1 < 1.) {
+          SeatState s = state;
+          place(s, next->winner_to[1], v, m_2);
+          place(s, next->loser_to[1], u, m_2);
+          next_states[s] += m_2;
+        }
+      }
+    }
+    states.swap(next_states);
+    max_states = (std::max)(max_states, states.size());
+    if (states.size() > EXACT_MAX_STATES)
+      throw_error("Too many sets are left to play for --exact: more than " +
+                  std::to_string(EXACT_MAX_STATES) + " assignments of players to the "
+                  "seats in play are possible at once; simulate instead");
+  }
+}
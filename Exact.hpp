@@ -0,0 +1,52 @@
+#ifndef EXACT_H
+#define EXACT_H
+
+#include <unordered_map>
+
+#include "Bracket.hpp"
+
+// Most joint states of the players still in the bracket that the exact
+// solver holds at once
+#define EXACT_MAX_STATES (1 << 21)
+
+// Joint state of the seats in play: the player in each slot, or EMPTY_SLOT
+typedef std::u16string SeatState;
+#define EMPTY_SLOT 0xFFFF
+
+// Exact placement probabilities for the static-rating case. When ratings are
+// not updated, every set is an independent trial with a fixed probability for
+// each pair of players, so instead of sampling, the probability of every
+// assignment of players to the seats still in play is carried through the
+// bracket one set at a time. Seats that share history (e.g. in losers finals,
+// the loser of winners finals and a player whose path depended on the same
+// winners bracket) are then exact too, since the joint distribution of who
+// holds them is kept rather than each seat's own.
+//
+// A player drops out of the state on reaching a placing seat, and states
+// that agree on the rest are merged, so the number of states depends on how
+// many sets are left to play at once. That suits the later stages of a
+// bracket, or small ones; if more than EXACT_MAX_STATES are needed, the
+// solver gives up, and the bracket has to be simulated.
+class ExactSolver {
+ public:
+  Bracket* bracket;
+  std::vector<std::vector<double>> placings;  // [player][placing]
+  size_t max_states;                          // Most states held at once
+
+  ExactSolver(Bracket*);
+  void solve();
+
+ private:
+  int num_players;
+  std::vector<int> order;       // Sets, in the order they are solved
+  std::vector<int> slot;        // Slot of the state holding each seat, or -1
+  std::vector<int> placing_of;  // Placing of each seat's occupant, or -1
+  int num_slots;
+
+  double p_win(int, int);
+  void plan();
+  int occupant(const SeatState&, int);
+  void place(SeatState&, int, int, double);
+};
+
+#endif
@@ -0,0 +1,110 @@
+#ifndef GLICKO_H
+#define GLICKO_H
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+
+// Fast Glicko kernel, used with --fast-glicko. The reference update in
+// Bracket::play works in mixed float/double precision, with two calls to pow
+// and four to sqrt per set; this one stays in float and replaces them with
+// the approximations below, written without calls or branches so that loops
+// over a batch of sets vectorize. Results are not bit-identical to the
+// reference, so the same seed gives slightly different output; `make
+// validate` checks the placement distributions and ratings against it.
+
+// The functions are forced inline, so that they are compiled for the
+// instruction set of each loop they are used in (e.g. each clone of the
+// lockstep engine's lane kernel) and vectorize along with it
+#if defined __GNUC__
+#define KERNEL_INLINE inline __attribute__((always_inline))
+#elif defined _MSC_VER
+#define KERNEL_INLINE __forceinline
+#else
+#define KERNEL_INLINE inline
+#endif
+
+// Constants of the kernel, worked out once by the caller (they are globals,
+// which the compiler cannot otherwise keep in registers across stores)
+struct GlickoConstants {
+  float c;   // 3 * (q / pi)^2, so that g(RD) = 1 / sqrt(1 + c * RD^2)
+  float q;
+  float qs;  // q^2
+
+  GlickoConstants(float pi, float q_, float qs_) {
+    c = 3.f * (q_ / pi) * (q_ / pi);
+    q = q_;
+    qs = qs_;
+  }
+};
+
+// Return 2^x, to a relative error below 4e-6 for |x| <= 126. The argument
+// is split into an integer n, put straight into the exponent bits, and a
+// fraction f in [-0.5, 0.5], for which 2^f is a degree 5 polynomial. n is
+// rounded off by adding and subtracting 1.5 * 2^23, which leaves it in the low
+// bits of the sum, and the polynomial is evaluated in three independent pairs
+// of terms, to keep the chain of dependent operations short.
+static KERNEL_INLINE float fast_exp2(float x) {
+  const float round = 12582912.f;
+  x = (std::min)((std::max)(x, -126.f), 126.f);
+  float t = x + round;
+  float f = x - (t - round);
+  uint32_t bits;
+  std::memcpy(&bits, &t, sizeof(bits));
+  bits = (bits + 127) << 23;
+  float scale;
+  std::memcpy(&scale, &bits, sizeof(scale));
+  float f2 = f * f;
+  float p01 = 1.f + 6.93147181e-1f * f;
+  float p23 = 2.40226507e-1f + 5.55041087e-2f * f;
+  float p45 = 9.61812911e-3f + 1.33335581e-3f * f;
+  return (p01 + f2 * (p23 + f2 * p45)) * scale;
+}
+
+// Return 1 / sqrt(x) for x > 0, to a relative error below 5e-6: an initial
+// guess from the exponent bits, refined by two Newton steps
+static KERNEL_INLINE float fast_rsqrt(float x) {
+  int32_t bits;
+  std::memcpy(&bits, &x, sizeof(bits));
+  bits = 0x5f375a86 - (bits >> 1);
+  float y;
+  std::memcpy(&y, &bits, sizeof(y));
+  y = y * (1.5f - 0.5f * x * y * y);
+  y = y * (1.5f - 0.5f * x * y * y);
+  return y;
+}
+
+// Return the Glicko expected score 1 / (1 + 10^(-g * dif / 400))
+static KERNEL_INLINE float fast_expected(float g, float dif) {
+  return 1.f / (1.f + fast_exp2(-g * dif * (3.32192809488736235f / 400.f)));
+}
+
+// Return the probability that player 1 wins a set against player 2
+static KERNEL_INLINE float fast_win_probability(float rating_1, float RD_1, float rating_2,
+                                                float RD_2, const GlickoConstants& k) {
+  float g = fast_rsqrt(1.f + k.c * (RD_1 * RD_1 + RD_2 * RD_2));
+  return fast_expected(g, rating_1 - rating_2);
+}
+
+// Update the ratings and RDs of both players of a set that player 1 won (s1
+// = 1) or lost (s1 = 0). As in the reference, the new RD is
+// 1 / sqrt(1/RD^2 + 1/d^2), floored at 30, and the change in rating is scaled
+// by its square before the floor.
+static KERNEL_INLINE void fast_glicko_update(float& rating_1, float& RD_1, float& rating_2,
+                                             float& RD_2, float s1, const GlickoConstants& k) {
+  float dif = rating_1 - rating_2;
+  float g1 = fast_rsqrt(1.f + k.c * RD_1 * RD_1);
+  float g2 = fast_rsqrt(1.f + k.c * RD_2 * RD_2);
+  float E1 = fast_expected(g2, dif);
+  float E2 = fast_expected(g1, -dif);
+  float w1 = 1.f / (RD_1 * RD_1) + k.qs * g2 * g2 * E1 * (1.f - E1);
+  float w2 = 1.f / (RD_2 * RD_2) + k.qs * g1 * g1 * E2 * (1.f - E2);
+  float new_RD_1 = fast_rsqrt(w1);
+  float new_RD_2 = fast_rsqrt(w2);
+  rating_1 += k.q * g2 * (s1 - E1) * new_RD_1 * new_RD_1;
+  rating_2 += k.q * g1 * ((1.f - s1) - E2) * new_RD_2 * new_RD_2;
+  RD_1 = (std::max)(30.f, new_RD_1);
+  RD_2 = (std::max)(30.f, new_RD_2);
+}
+
+#endif
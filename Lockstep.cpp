@@ -0,0 +1,226 @@
+#include <cstring>
+
+#include "Lockstep.hpp"
+
+// Compile the lane kernel for several instruction sets and pick one at load
+// time; other platforms get a single portable build
+#if defined __GNUC__ && !defined __clang__ && defined __x86_64__ && defined __linux__
+#define LANE_TARGETS __attribute__((target_clones("avx512f", "avx2", "default")))
+#else
+#define LANE_TARGETS
+#endif
+
+// Return e^x for a single lane. Cephes-style range reduction and polynomial,
+// accurate to about 2 ulp; written without calls or branches so that loops
+// over lanes vectorize.
+static inline float exp_lane(float x) {
+  x = (std::min)((std::max)(x, -87.3f), 88.3f);
+  float t = x * 1.44269504088896341f;
+  int n = (int) (t + (t < 0.f ? -0.5f : 0.5f));
+  float r = x - n * 0.693359375f + n * 2.12194440e-4f;
+  float p = 1.9875691500e-4f;
+  p = p * r + 1.3981999507e-3f;
+  p = p * r + 8.3334519073e-3f;
+  p = p * r + 4.1665795894e-2f;
+  p = p * r + 1.6666665459e-1f;
+  p = p * r + 5.0000001201e-1f;
+  float y = p * r * r + r + 1.f;
+  int32_t bits = (n + 127) << 23;
+  float scale;
+  std::memcpy(&scale, &bits, sizeof(scale));
+  return y * scale;
+}
+
+// Return the Glicko expected score 1 / (1 + 10^(-g * dif / 400))
+static inline float expected_lane(float g, float dif) {
+  return 1.f / (1.f + exp_lane(-g * dif * (2.30258509299404568f / 400.f)));
+}
+
+// Run the bracket program across all lanes
+LANE_TARGETS
+static void run_lanes(const MatchOp* program, int num_ops, int* seats,
+                      float* rating, float* RD, const RandomStream* streams,
+                      const float* win_prob, int num_players, bool update, bool fast,
+                      int* results) {
+  const GlickoConstants constants(pi, q, qs);
+  const float c = 3.f * square(q / pi);
+  const float fqs = qs;
+  const float fq = q;
+  int last[LANES];
+  int res[LANES];
+  float r1[LANES], r2[LANES], d1[LANES], d2[LANES];
+
+  for (int l = 0; l < LANES; l++)
+    last[l] = 0;
+
+  for (int k = 0; k < num_ops; k++) {
+    const MatchOp& op = program[k];
+    const int* p1 = seats + op.seat * LANES;
+    const int* p2 = p1 + LANES;
+
+    // Gather the ratings and RDs of both players
+    #pragma omp simd
+    for (int l = 0; l < LANES; l++) {
+      r1[l] = rating[p1[l] * LANES + l];
+      r2[l] = rating[p2[l] * LANES + l];
+      d1[l] = RD[p1[l] * LANES + l];
+      d2[l] = RD[p2[l] * LANES + l];
+    }
+
+    // Determine a winner
+    if (op.result_fixed == 0 && win_prob != NULL) {
+      #pragma omp simd
+      for (int l = 0; l < LANES; l++) {
+        float E = win_prob[p1[l] * num_players + p2[l]];
+        res[l] = E > streams[l].uniform(k) ? 1 : 2;
+      }
+    } else if (op.result_fixed == 0 && fast) {
+      #pragma omp simd
+      for (int l = 0; l < LANES; l++) {
+        float E = fast_win_probability(r1[l], d1[l], r2[l], d2[l], constants);
+        res[l] = E > streams[l].uniform(k) ? 1 : 2;
+      }
+    } else if (op.result_fixed == 0) {
+      #pragma omp simd
+      for (int l = 0; l < LANES; l++) {
+        float g = 1.f / sqrtf(1.f + c * (d1[l] * d1[l] + d2[l] * d2[l]));
+        float E = expected_lane(g, r1[l] - r2[l]);
+        res[l] = E > streams[l].uniform(k) ? 1 : 2;
+      }
+    } else {
+      for (int l = 0; l < LANES; l++)
+        res[l] = op.result_fixed;
+    }
+
+    // Lanes where the set is not played (GF2 without a bracket reset) keep
+    // their seats and ratings as they are
+    bool all_active = true;
+    if (op.conditional)
+      for (int l = 0; l < LANES; l++)
+        all_active &= last[l] == 2;
+
+    // Send the players to their next match
+    if (all_active && op.winner_to[0] == op.winner_to[1] &&
+        op.loser_to[0] == op.loser_to[1]) {
+      int* wt = seats + op.winner_to[0] * LANES;
+      int* lt = seats + op.loser_to[0] * LANES;
+      #pragma omp simd
+      for (int l = 0; l < LANES; l++) {
+        wt[l] = res[l] == 1 ? p1[l] : p2[l];
+        lt[l] = res[l] == 1 ? p2[l] : p1[l];
+      }
+    } else {
+      for (int l = 0; l < LANES; l++) {
+        if (op.conditional && last[l] != 2)
+          continue;
+        int r = res[l] - 1;
+        seats[op.winner_to[r] * LANES + l] = res[l] == 1 ? p1[l] : p2[l];
+        seats[op.loser_to[r] * LANES + l] = res[l] == 1 ? p2[l] : p1[l];
+      }
+    }
+
+    // Update ratings and RDs, with the fast kernel applied to the whole batch
+    // of lanes at once
+    if (update && fast) {
+      #pragma omp simd
+      for (int l = 0; l < LANES; l++)
+        fast_glicko_update(r1[l], d1[l], r2[l], d2[l], res[l] == 1 ? 1.f : 0.f, constants);
+    } else if (update) {
+      #pragma omp simd
+      for (int l = 0; l < LANES; l++) {
+        float s1 = res[l] == 1 ? 1.f : 0.f;
+        float dif = r1[l] - r2[l];
+        float g1 = 1.f / sqrtf(1.f + c * d1[l] * d1[l]);
+        float g2 = 1.f / sqrtf(1.f + c * d2[l] * d2[l]);
+        float E1 = expected_lane(g2, dif);
+        float E2 = expected_lane(g1, -dif);
+        float x1 = 1.f / (d1[l] * d1[l]);
+        float x2 = 1.f / (d2[l] * d2[l]);
+        float v1 = 1.f / (x1 + fqs * g2 * g2 * E1 * (1.f - E1));
+        float v2 = 1.f / (x2 + fqs * g1 * g1 * E2 * (1.f - E2));
+        d1[l] = (std::max)(30.f, sqrtf(v1));
+        d2[l] = (std::max)(30.f, sqrtf(v2));
+        r1[l] += fq * g2 * (s1 - E1) * v1;
+        r2[l] += fq * g1 * ((1.f - s1) - E2) * v2;
+      }
+    }
+    if (update) {
+      for (int l = 0; l < LANES; l++) {
+        if (op.conditional && last[l] != 2)
+          continue;
+        rating[p1[l] * LANES + l] = r1[l];
+        rating[p2[l] * LANES + l] = r2[l];
+        RD[p1[l] * LANES + l] = d1[l];
+        RD[p2[l] * LANES + l] = d2[l];
+      }
+    }
+
+    for (int l = 0; l < LANES; l++) {
+      bool active = !op.conditional || last[l] == 2;
+      results[k * LANES + l] = active ? res[l] : 0;
+      if (active)
+        last[l] = res[l];
+    }
+  }
+}
+
+// Lockstep engine constructor
+LockstepEngine::LockstepEngine(Bracket* b) {
+  bracket = b;
+  num_players = bracket->players_in_bracket.size();
+
+  // Every lane starts from the bracket's initial seats
+  seats.resize(bracket->seats.size() * LANES);
+  for (int s = 0; s < bracket->seats.size(); s++)
+    for (int l = 0; l < LANES; l++)
+      seats[s * LANES + l] = bracket->seats[s];
+
+  results.resize(bracket->program.size() * LANES);
+  rating.resize(num_players * LANES);
+  RD.resize(num_players * LANES);
+  for (int i = 0; i < num_players; i++) {
+    rating_orig.push_back(bracket->players_in_bracket[i]->rating_orig);
+    RD_orig.push_back(bracket->players_in_bracket[i]->RD_orig);
+  }
+}
+
+// Simulate a block of consecutive simulations, starting from first_sim, one per
+// lane. Lanes beyond num_sims are run but not recorded.
+void LockstepEngine::simulate(uint64_t seed, uint64_t first_sim, int num_sims) {
+  assert(num_sims > 0 && num_sims <= LANES);
+  play(seed, first_sim);
+
+  // Update player results
+  int64_t* counts = bracket->placing_counts;
+  int num_placings = bracket->num_rounds_P;
+  for (std::vector<PlacingSeat>::iterator it = bracket->placing_seats.begin();
+       it != bracket->placing_seats.end(); it++)
+    for (int l = 0; l < num_sims; l++)
+      counts[seats[it->seat * LANES + l] * num_placings + it->placing] += 1;
+  if (!bracket->strata.empty())
+    for (int l = 0; l < num_sims; l++)
+      bracket->update_strata(results.data() + l, seats.data() + l, LANES);
+}
+
+// Play every set of a block of simulations, recording the result of each set in
+// each lane in `results` ([op][lane])
+void LockstepEngine::play(uint64_t seed, uint64_t first_sim) {
+  for (int l = 0; l < LANES; l++)
+    streams[l] = RandomStream(seed, first_sim + l);
+  for (int i = 0; i < num_players; i++)
+    for (int l = 0; l < LANES; l++) {
+      rating[i * LANES + l] = rating_orig[i];
+      RD[i * LANES + l] = RD_orig[i];
+    }
+
+  run_lanes(bracket->program.data(), bracket->program.size(), seats.data(),
+            rating.data(), RD.data(), streams,
+            bracket->win_prob.empty() ? NULL : bracket->win_prob.data(),
+            num_players, update_ratings, fast_glicko, results.data());
+}
+
+// Swap the players in two seats of every lane, e.g. to reseed the bracket
+void LockstepEngine::swap_seats(int a, int b) {
+  for (int l = 0; l < LANES; l++)
+    std::swap(seats[a * LANES + l], seats[b * LANES + l]);
+}
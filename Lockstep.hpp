@@ -0,0 +1,54 @@
+#ifndef LOCKSTEP_H
+#define LOCKSTEP_H
+
+#include "Bracket.hpp"
+
+// Number of simulations run side by side by a lockstep engine; enough to fill
+// one AVX-512 or two AVX2 registers of floats
+#define LANES 16
+
+// Blocks of lanes covering simulations [first, first + count). Block b runs
+// those from first + b * LANES on, so a range that does not start on a whole
+// block, such as the rest of a resumed run, still runs each simulation once,
+// with the random numbers of its index.
+struct LaneBlocks {
+  int64_t first, count;
+
+  int64_t size() const {
+    return (count + LANES - 1) / LANES;
+  }
+  uint64_t first_sim(int64_t b) const {
+    return first + b * LANES;
+  }
+  int num_sims(int64_t b) const {
+    return (std::min)((int64_t) LANES, count - b * LANES);
+  }
+};
+
+// Lockstep simulation engine. The bracket program is the same in every
+// simulation and only the winners differ, so a block of LANES independent
+// simulations is run through the program together, each set being played in
+// every lane at once. Seats, ratings and RDs are stored lane-minor
+// ([index][lane]) so that every step of a set is a vector operation across
+// lanes, with gathers and scatters through the player IDs in the seats.
+// Results are accumulated into the placing counts of the bracket.
+class LockstepEngine {
+ public:
+  Bracket* bracket;
+
+  std::vector<int> seats;    // [seat][lane]
+  std::vector<int> results;  // [op][lane]
+
+  LockstepEngine(Bracket*);
+  void simulate(uint64_t, uint64_t, int);
+  void play(uint64_t, uint64_t);
+  void swap_seats(int, int);
+
+ private:
+  int num_players;
+  std::vector<float> rating, RD;
+  std::vector<float> rating_orig, RD_orig;
+  RandomStream streams[LANES];
+};
+
+#endif
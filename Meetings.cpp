@@ -0,0 +1,260 @@
+#include "Meetings.hpp"
+
+// Hash table constructor, for at most the given number of keys
+MeetingTable::MeetingTable(size_t max_keys) {
+  max_capacity = SPARSE_MEETINGS_MIN_CAPACITY;
+  while (max_capacity < SPARSE_MEETINGS_MAX_CAPACITY && max_capacity / 4 * 3 < max_keys)
+    max_capacity *= 2;
+  keys.assign(SPARSE_MEETINGS_MIN_CAPACITY, 0);
+  values.assign(SPARSE_MEETINGS_MIN_CAPACITY, MeetingCounts{0, 0, 0, -1});
+  num_keys = 0;
+  shift = 64;
+  for (size_t c = keys.size(); c > 1; c /= 2)
+    shift--;
+}
+
+// Double the capacity, moving every key to its slot in the larger table
+void MeetingTable::grow() {
+  std::vector<uint64_t> old_keys;
+  std::vector<MeetingCounts> old_values;
+  old_keys.swap(keys);
+  old_values.swap(values);
+  keys.assign(old_keys.size() * 2, 0);
+  values.assign(old_keys.size() * 2, MeetingCounts{0, 0, 0, -1});
+  num_keys = 0;
+  shift--;
+  for (size_t h = 0; h < old_keys.size(); h++)
+    if (old_keys[h] != 0)
+      *find(old_keys[h], true) = old_values[h];
+}
+
+// Find the counts of a key, adding it if asked to and there is room. Returns
+// NULL if it is not there.
+MeetingCounts* MeetingTable::find(uint64_t key, bool add) {
+  // Linear probing from a multiplicative hash
+  uint64_t mask = keys.size() - 1;
+  uint64_t h = (key * 0x9E3779B97F4A7C15ULL) >> shift;
+  while (true) {
+    h &= mask;
+    if (keys[h] == key)
+      return &values[h];
+    if (keys[h] == 0)
+      break;
+    h++;
+  }
+  if (!add)
+    return NULL;
+  if (num_keys >= keys.size() / 4 * 3) {
+    if (keys.size() >= max_capacity)
+      return NULL;
+    grow();
+    return find(key, true);
+  }
+  keys[h] = key;
+  num_keys++;
+  return &values[h];
+}
+
+// Key of a pair of players, player_1 < player_2, in a round (or -1 for any)
+static uint64_t meeting_key(int id_1, int id_2, int round) {
+  return ((uint64_t) id_1 + 1) << 40 | ((uint64_t) id_2 + 1) << 16 | (round + 1);
+}
+
+struct by_pair_and_round {
+  bool operator()(const Meeting& m1, const Meeting& m2) {
+    if (m1.player_1 != m2.player_1)
+      return m1.player_1 < m2.player_1;
+    if (m1.player_2 != m2.player_2)
+      return m1.player_2 < m2.player_2;
+    return m1.round < m2.round;
+  }
+};
+
+// Meeting matrix constructor
+MeetingMatrix::MeetingMatrix(Bracket* b) {
+  bracket = b;
+  num_players = bracket->players_in_bracket.size();
+  if (num_players > MEETINGS_MAX_PLAYERS)
+    throw_error("--meetings supports at most " + std::to_string(MEETINGS_MAX_PLAYERS) +
+                " players");
+  gf1_op = bracket->grands[1]->matches[0]->op;
+  dense = num_players <= DENSE_MEETINGS_MAX;
+  size_t max_pairs = (size_t) num_players * (num_players - 1) / 2;
+  if (dense)
+    matrix.assign(num_players * num_players, MeetingCounts{0, 0, 0, -1});
+  else
+    sparse = MeetingTable(max_pairs);
+
+  // Rounds, named as in bracket_params.txt, and the round of each set
+  round_of.assign(bracket->program.size(), -1);
+  for (std::vector<Round*>* side : {&bracket->winners, &bracket->losers, &bracket->grands})
+    for (int i = 0; i < side->size(); i++) {
+      for (int j = 0; j < (*side)[i]->num_matches; j++)
+        if ((*side)[i]->matches[j]->op >= 0)
+          round_of[(*side)[i]->matches[j]->op] = round_names.size();
+      round_names.push_back((*side)[i]->side + std::to_string(i));
+    }
+  by_round = MeetingTable(max_pairs * round_names.size());
+  num_sims = 0;
+  num_dropped = 0;
+}
+
+// Find the counts of a pair over the whole bracket, adding it if there is
+// room. Returns NULL if it is not there.
+MeetingCounts* MeetingMatrix::find(int id_1, int id_2) {
+  if (dense)
+    return &matrix[id_1 * num_players + id_2];
+  return sparse.find(meeting_key(id_1, id_2, -1), true);
+}
+
+// Record the meetings of a finished simulation, given the player in each seat
+// and the result of each set, [index * stride]
+void MeetingMatrix::record(const int* seats, const int* results, int stride) {
+  std::vector<MatchOp>& program = bracket->program;
+  for (int k = 0; k < program.size(); k++) {
+    if (results[k * stride] == 0)
+      continue;
+    int id_1 = seats[program[k].seat * stride];
+    int id_2 = seats[(program[k].seat + 1) * stride];
+    if (id_1 > id_2)
+      std::swap(id_1, id_2);
+
+    // A pair meets at most once per round
+    MeetingCounts* in_round = by_round.find(meeting_key(id_1, id_2, round_of[k]), true);
+    MeetingCounts* counts = find(id_1, id_2);
+    if (in_round == NULL || counts == NULL)
+      num_dropped++;
+    if (in_round != NULL)
+      in_round->sets++;
+    if (counts == NULL)
+      continue;
+    counts->sets++;
+    if (k == gf1_op)
+      counts->grand_finals++;
+
+    // A pair can meet more than once, e.g. again in losers bracket or grand
+    // finals, but counts once per simulation
+    if (counts->last_sim != num_sims) {
+      counts->last_sim = num_sims;
+      counts->sims++;
+    }
+  }
+  num_sims++;
+}
+
+// Add the counts of another thread's matrix into this one
+void MeetingMatrix::merge(MeetingMatrix& other) {
+  std::vector<Meeting> other_pairs = other.pairs();
+  for (int i = 0; i < other_pairs.size(); i++) {
+    MeetingCounts* counts = find(other_pairs[i].player_1, other_pairs[i].player_2);
+    if (counts == NULL) {
+      num_dropped += other_pairs[i].counts.sets;
+      continue;
+    }
+    counts->sets += other_pairs[i].counts.sets;
+    counts->sims += other_pairs[i].counts.sims;
+    counts->grand_finals += other_pairs[i].counts.grand_finals;
+  }
+  for (int h = 0; h < other.by_round.keys.size(); h++) {
+    if (other.by_round.keys[h] == 0)
+      continue;
+    MeetingCounts* counts = by_round.find(other.by_round.keys[h], true);
+    if (counts == NULL)
+      num_dropped += other.by_round.values[h].sets;
+    else
+      counts->sets += other.by_round.values[h].sets;
+  }
+  num_dropped += other.num_dropped;
+}
+
+// Return every pair that has met, with their counts over the whole bracket
+std::vector<Meeting> MeetingMatrix::pairs() {
+  std::vector<Meeting> out;
+  if (dense) {
+    for (int i = 0; i < num_players; i++)
+      for (int j = i + 1; j < num_players; j++)
+        if (matrix[i * num_players + j].sets > 0)
+          out.push_back(Meeting{i, j, -1, matrix[i * num_players + j]});
+  } else {
+    for (int h = 0; h < sparse.keys.size(); h++)
+      if (sparse.keys[h] != 0)
+        out.push_back(Meeting{(int) (sparse.keys[h] >> 40) - 1,
+                              (int) (sparse.keys[h] >> 16 & 0xFFFFFF) - 1, -1,
+                              sparse.values[h]});
+  }
+  return out;
+}
+
+// Return every pair that has met in each round, with the number of sets they
+// played in it, sorted by pair and round
+std::vector<Meeting> MeetingMatrix::pairs_by_round() {
+  std::vector<Meeting> out;
+  for (int h = 0; h < by_round.keys.size(); h++)
+    if (by_round.keys[h] != 0)
+      out.push_back(Meeting{(int) (by_round.keys[h] >> 40) - 1,
+                            (int) (by_round.keys[h] >> 16 & 0xFFFFFF) - 1,
+                            (int) (by_round.keys[h] & 0xFFFF) - 1, by_round.values[h]});
+  std::sort(out.begin(), out.end(), by_pair_and_round());
+  return out;
+}
+
+struct by_sims_met {
+  bool operator()(const Meeting& m1, const Meeting& m2) {
+    return m1.counts.sims > m2.counts.sims;
+  }
+};
+
+// Merge the threads' meeting counts and print the most likely meetings out of
+// n simulations, also writing every pair, over the bracket and in each round,
+// to a CSV file if one is given
+void print_meetings(std::vector<MeetingMatrix*>& meetings, Bracket* bracket, int64_t n,
+                    std::string fname) {
+  for (int t = 1; t < meetings.size(); t++)
+    meetings[0]->merge(*meetings[t]);
+  std::vector<Meeting> pairs = meetings[0]->pairs();
+  std::sort(pairs.begin(), pairs.end(), by_sims_met());
+  std::vector<Player*>& players = bracket->players_in_bracket;
+
+  // Pairs certain to meet are left out
+  printf("  %-16s  %-16s%9s%9s%9s\n", "Player 1", "Player 2", "Meet", "GF", "Sets");
+  printf("  %s\n", std::string(61, '-').c_str());
+  int num_printed = 0;
+  for (int i = 0; i < pairs.size() && num_printed < 20; i++) {
+    if (pairs[i].counts.sims == n)
+      continue;
+    num_printed++;
+    printf("  %-16s  %-16s  %6.2f%%  %6.2f%%  %7.4f\n",
+           players[pairs[i].player_1]->name.c_str(), players[pairs[i].player_2]->name.c_str(),
+           100. * pairs[i].counts.sims / n, 100. * pairs[i].counts.grand_finals / n,
+           (double) pairs[i].counts.sets / n);
+  }
+  printf("\n");
+
+  if (meetings[0]->num_dropped > 0)
+    throw_warning(std::to_string(meetings[0]->num_dropped) + " sets were not counted in "
+                  "full because a table of meetings was full");
+
+  // Each pair's row over the whole bracket (round "all") is followed by one
+  // row for each round in which they met, in which they play at most once
+  if (!fname.empty()) {
+    FILE* out = fopen(fname.c_str(), "w");
+    if (out == NULL)
+      throw_error("Unable to write " + fname);
+    std::vector<Meeting> rounds = meetings[0]->pairs_by_round();
+    std::vector<std::string>& round_names = meetings[0]->round_names;
+    fprintf(out, "player_1,player_2,round,p_meet,sets_per_bracket\n");
+    for (int i = 0; i < pairs.size(); i++) {
+      const char* name_1 = players[pairs[i].player_1]->name.c_str();
+      const char* name_2 = players[pairs[i].player_2]->name.c_str();
+      fprintf(out, "%s,%s,all,%.8g,%.8g\n", name_1, name_2, (double) pairs[i].counts.sims / n,
+              (double) pairs[i].counts.sets / n);
+      std::vector<Meeting>::iterator r = std::lower_bound(rounds.begin(), rounds.end(),
+                                                          pairs[i], by_pair_and_round());
+      for (; r != rounds.end() && r->player_1 == pairs[i].player_1 &&
+             r->player_2 == pairs[i].player_2; r++)
+        fprintf(out, "%s,%s,%s,%.8g,%.8g\n", name_1, name_2, round_names[r->round].c_str(),
+                (double) r->counts.sets / n, (double) r->counts.sets / n);
+    }
+    fclose(out);
+  }
+}
@@ -0,0 +1,83 @@
+#ifndef MEETINGS_H
+#define MEETINGS_H
+
+#include "Bracket.hpp"
+
+// Largest field whose meetings are counted in a dense matrix; larger fields
+// use a hash table of the pairs that actually meet
+#define DENSE_MEETINGS_MAX 512
+
+// Slots of a hash table of meetings when it is created, and the most it grows
+// to. A table doubles whenever it is 3/4 full, but never past the number of
+// keys the field can have; once at the limit and 3/4 full, keys not yet in it
+// are no longer counted, which is reported.
+#define SPARSE_MEETINGS_MIN_CAPACITY (1 << 10)
+#define SPARSE_MEETINGS_MAX_CAPACITY (1 << 22)
+
+// Most players whose meetings can be counted, as keys hold 24 bits per player
+#define MEETINGS_MAX_PLAYERS ((1 << 24) - 1)
+
+// How often each pair of players meets, [player_1 < player_2]
+struct MeetingCounts {
+  int64_t sets;          // Sets played against each other
+  int64_t sims;          // Simulations in which they played at least once
+  int64_t grand_finals;  // Simulations in which they met in grand finals
+  int64_t last_sim;      // Last simulation (of this thread) in which they met
+};
+
+// Counts of a pair of players, in one round, or over the whole bracket if the
+// round is -1
+struct Meeting {
+  int player_1, player_2;
+  int round;
+  MeetingCounts counts;
+};
+
+// Hash table of meeting counts, by key, with open addressing and linear
+// probing. Key 0 marks an empty slot.
+class MeetingTable {
+ public:
+  std::vector<uint64_t> keys;
+  std::vector<MeetingCounts> values;
+
+  MeetingTable(size_t = 0);
+  MeetingCounts* find(uint64_t, bool);
+
+ private:
+  size_t max_capacity;
+  size_t num_keys;
+  int shift;  // 64 - log2 of the capacity
+
+  void grow();
+};
+
+// Head-to-head meeting counts for one thread. Every set's players are still in
+// their seats at the end of a simulation, so the meetings are recorded from
+// the seats and results afterwards, leaving the simulation itself untouched.
+class MeetingMatrix {
+ public:
+  MeetingMatrix(Bracket*);
+  void record(const int*, const int*, int);
+  void merge(MeetingMatrix&);
+  std::vector<Meeting> pairs();
+  std::vector<Meeting> pairs_by_round();
+  std::vector<std::string> round_names;  // e.g. W3, L2 or G1
+  int64_t num_dropped;  // Sets not counted in full, as a table was full
+
+ private:
+  Bracket* bracket;
+  int num_players;
+  int gf1_op;
+  bool dense;
+  std::vector<MeetingCounts> matrix;  // [player_1 * num_players + player_2]
+  MeetingTable sparse;                // Pairs, when the field is not dense
+  MeetingTable by_round;              // Pairs in each round; only sets are kept
+  std::vector<int> round_of;          // Round of each set in the program
+  int64_t num_sims;
+
+  MeetingCounts* find(int, int);
+};
+
+void print_meetings(std::vector<MeetingMatrix*>&, Bracket*, int64_t, std::string);
+
+#endif
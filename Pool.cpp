@@ -0,0 +1,99 @@
+#include "Pool.hpp"
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+// Worker pool constructor. With pinning, worker t is bound to the t-th CPU the
+// process may run on (wrapping around if there are more workers than CPUs).
+WorkerPool::WorkerPool(int num_workers, bool pin) {
+  task = NULL;
+  generation = 0;
+  num_running = 0;
+  stopping = false;
+
+  std::vector<int> cpus;
+  if (pin) {
+#ifdef __linux__
+    cpu_set_t allowed;
+    if (sched_getaffinity(0, sizeof(allowed), &allowed) == 0)
+      for (int c = 0; c < CPU_SETSIZE; c++)
+        if (CPU_ISSET(c, &allowed))
+          cpus.push_back(c);
+#endif
+    if (cpus.empty())
+      throw_warning("Threads cannot be pinned on this system; running unpinned");
+  }
+
+  for (int t = 0; t < num_workers; t++)
+    workers.push_back(std::thread(&WorkerPool::work, this, t,
+                                  cpus.empty() ? -1 : cpus[t % cpus.size()]));
+}
+
+// Worker pool destructor
+WorkerPool::~WorkerPool() {
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    stopping = true;
+  }
+  started.notify_all();
+  for (int t = 0; t < workers.size(); t++)
+    workers[t].join();
+}
+
+// Body of worker t, pinned to the given CPU unless it is -1: wait for each task
+// and run it
+void WorkerPool::work(int t, int cpu) {
+#ifdef __linux__
+  if (cpu >= 0) {
+    cpu_set_t cpu_set;
+    CPU_ZERO(&cpu_set);
+    CPU_SET(cpu, &cpu_set);
+    pthread_setaffinity_np(pthread_self(), sizeof(cpu_set), &cpu_set);
+  }
+#endif
+
+  uint64_t done = 0;
+  std::unique_lock<std::mutex> lock(mutex);
+  while (true) {
+    started.wait(lock, [&] { return stopping || generation > done; });
+    if (stopping)
+      return;
+    done = generation;
+    lock.unlock();
+    (*task)(t);
+    lock.lock();
+    if (--num_running == 0)
+      finished.notify_one();
+  }
+}
+
+// Run a task once on every worker, passing it the worker's number, and wait
+// for all of them to finish
+void WorkerPool::run(const std::function<void(int)>& f) {
+  std::unique_lock<std::mutex> lock(mutex);
+  task = &f;
+  num_running = workers.size();
+  generation++;
+  started.notify_all();
+  finished.wait(lock, [this] { return num_running == 0; });
+  task = NULL;
+}
+
+// Run the iterations [begin, end) across the workers, in chunks of consecutive
+// iterations passed to the body along with the worker's number
+void WorkerPool::parallel_for(int64_t begin, int64_t end,
+                              const std::function<void(int, int64_t, int64_t)>& body) {
+  int64_t chunk = (std::max)((end - begin) / ((int64_t) workers.size() * CHUNKS_PER_WORKER),
+                             (int64_t) 1);
+  std::atomic<int64_t> next(begin);
+  run([&](int t) {
+    while (true) {
+      int64_t first = next.fetch_add(chunk);
+      if (first >= end)
+        break;
+      body(t, first, (std::min)(first + chunk, end));
+    }
+  });
+}
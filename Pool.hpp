@@ -0,0 +1,44 @@
+#ifndef POOL_H
+#define POOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+#include "Bracket.hpp"
+
+// Chunks each worker gets on average in a parallel loop; more even out the
+// load at the cost of more trips to the shared counter
+#define CHUNKS_PER_WORKER 16
+
+// Pool of worker threads, an alternative to the OpenMP loops. Each worker can
+// be pinned to its own CPU, and builds the brackets it will simulate itself, so
+// that their memory is first touched (and placed, on NUMA machines) by the
+// thread that uses it. Parallel loops are handed out in fixed chunks of
+// consecutive iterations from a shared counter, so a worker that finishes
+// early takes the next chunk rather than waiting.
+class WorkerPool {
+ public:
+  WorkerPool(int, bool);
+  ~WorkerPool();
+  int size() {
+    return workers.size();
+  }
+  void run(const std::function<void(int)>&);
+  void parallel_for(int64_t, int64_t, const std::function<void(int, int64_t, int64_t)>&);
+
+ private:
+  std::vector<std::thread> workers;
+  std::mutex mutex;
+  std::condition_variable started, finished;
+  const std::function<void(int)>* task;  // Run once by every worker
+  uint64_t generation;  // Number of tasks started
+  int num_running;
+  bool stopping;
+
+  void work(int, int);
+};
+
+#endif
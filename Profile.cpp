@@ -0,0 +1,146 @@
+#include "Profile.hpp"
+
+#ifdef PROFILE
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+Profiler profiler;
+
+const char* phase_names[NUM_PHASES] = {"Parsing", "Setup", "Simulation", "Reduction",
+                                       "Printing"};
+
+// Profiler constructor; it records nothing until enabled
+Profiler::Profiler() {
+  enabled = false;
+  for (int p = 0; p < NUM_PHASES; p++)
+    phase_time[p] = std::chrono::steady_clock::duration::zero();
+}
+
+// Start recording, for the given number of simulation threads
+void Profiler::enable(int num_threads) {
+  enabled = true;
+  threads.resize(num_threads);
+  for (int t = 0; t < num_threads; t++) {
+    threads[t].busy = std::chrono::steady_clock::duration::zero();
+    threads[t].sims = 0;
+    for (int c = 0; c < NUM_COUNTERS; c++) {
+      threads[t].fds[c] = -1;
+      threads[t].counts[c] = 0;
+    }
+  }
+}
+
+void Profiler::start_phase(ProfilePhase phase) {
+  if (enabled)
+    phase_start[phase] = std::chrono::steady_clock::now();
+}
+
+void Profiler::end_phase(ProfilePhase phase) {
+  if (enabled)
+    phase_time[phase] += std::chrono::steady_clock::now() - phase_start[phase];
+}
+
+// Start counting the hardware events of the calling thread, as thread t. The
+// counters are opened as one group, so they all cover the same cycles; if any
+// of them cannot be opened, the thread is not counted.
+void Profiler::start_counters(int t) {
+  if (!enabled)
+    return;
+#ifdef __linux__
+  const uint64_t events[NUM_COUNTERS] = {PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS,
+                                         PERF_COUNT_HW_CACHE_MISSES,
+                                         PERF_COUNT_HW_BRANCH_MISSES};
+  int* fds = threads[t].fds;
+  for (int c = 0; c < NUM_COUNTERS; c++) {
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.size = sizeof(attr);
+    attr.config = events[c];
+    attr.disabled = c == 0;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    attr.read_format = PERF_FORMAT_GROUP;
+    fds[c] = syscall(__NR_perf_event_open, &attr, 0, -1, c == 0 ? -1 : fds[0], 0);
+    if (fds[c] < 0) {
+      for (int d = 0; d < c; d++)
+        close(fds[d]);
+      fds[0] = -1;
+      return;
+    }
+  }
+  ioctl(fds[0], PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+  ioctl(fds[0], PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+#endif
+}
+
+// Stop counting the hardware events of thread t, adding them to its totals
+void Profiler::stop_counters(int t) {
+  if (!enabled || threads[t].fds[0] < 0)
+    return;
+#ifdef __linux__
+  int* fds = threads[t].fds;
+  ioctl(fds[0], PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP);
+  uint64_t values[1 + NUM_COUNTERS];
+  if (read(fds[0], values, sizeof(values)) == sizeof(values))
+    for (int c = 0; c < NUM_COUNTERS; c++)
+      threads[t].counts[c] += values[1 + c];
+  for (int c = 0; c < NUM_COUNTERS; c++) {
+    close(fds[c]);
+    fds[c] = -1;
+  }
+#endif
+}
+
+// Print the time spent in each phase, then each thread's simulations, the
+// time spent in them and its hardware counts
+void Profiler::print(FILE* out) {
+  if (!enabled)
+    return;
+
+  double total = 0.;
+  for (int p = 0; p < NUM_PHASES; p++)
+    total += std::chrono::duration<double>(phase_time[p]).count();
+  fprintf(out, "Profile:\n");
+  fprintf(out, "  %-14s%12s%9s\n", "Phase", "Seconds", "Share");
+  fprintf(out, "  %s\n", std::string(35, '-').c_str());
+  for (int p = 0; p < NUM_PHASES; p++) {
+    double seconds = std::chrono::duration<double>(phase_time[p]).count();
+    fprintf(out, "  %-14s%12.6f%8.2f%%\n", phase_names[p], seconds,
+            total > 0. ? 100. * seconds / total : 0.);
+  }
+  fprintf(out, "\n");
+
+  bool counted = false;
+  for (int t = 0; t < threads.size(); t++)
+    counted = counted || threads[t].counts[0] > 0;
+  fprintf(out, "  %-8s%12s%12s%10s", "Thread", "Sims", "Busy (s)", "us/sim");
+  if (counted)
+    fprintf(out, "%14s%14s%7s%12s%12s", "Cycles/sim", "Instr/sim", "IPC", "Cache miss",
+            "Branch miss");
+  fprintf(out, "\n");
+  fprintf(out, "  %s\n", std::string(counted ? 101 : 42, '-').c_str());
+  for (int t = 0; t < threads.size(); t++) {
+    const ThreadProfile& thread = threads[t];
+    double busy = std::chrono::duration<double>(thread.busy).count();
+    double sims = (std::max)(thread.sims, (int64_t) 1);
+    fprintf(out, "  %-8d%12" PRId64 "%12.4f%10.3f", t, thread.sims, busy, 1.e6 * busy / sims);
+    if (counted)
+      fprintf(out, "%14.0f%14.0f%7.2f%12.1f%12.1f", thread.counts[0] / sims,
+              thread.counts[1] / sims,
+              thread.counts[0] > 0 ? (double) thread.counts[1] / thread.counts[0] : 0.,
+              thread.counts[2] / sims, thread.counts[3] / sims);
+    fprintf(out, "\n");
+  }
+  if (!counted)
+    fprintf(out, "  (hardware counters unavailable; perf_event_open is Linux only and may be "
+            "restricted by /proc/sys/kernel/perf_event_paranoid)\n");
+  fprintf(out, "\n");
+}
+
+#endif
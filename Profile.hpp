@@ -0,0 +1,85 @@
+#ifndef PROFILE_H
+#define PROFILE_H
+
+#include "Bracket.hpp"
+
+// Phases of a run, as timed by the profiler
+enum ProfilePhase {
+  PHASE_PARSING,     // Reading the bracket, initial bracket and player files
+  PHASE_SETUP,       // Building the brackets, engines and tables of every thread
+  PHASE_SIMULATION,  // The simulation loop
+  PHASE_REDUCTION,   // Merging the threads' counts
+  PHASE_PRINTING,    // Printing the results
+  NUM_PHASES
+};
+
+// Instrumentation, built by `make profile` (which defines PROFILE) and turned
+// on at run time with --profile. In other builds the macros below expand to
+// nothing, so no recording is compiled in at all.
+//
+// The profiler times each phase of the run (a phase may be entered several
+// times, e.g. once per batch), and the time each thread spends inside its
+// simulations. Where perf_event_open is available (Linux, subject to
+// perf_event_paranoid), each thread also counts cycles, instructions, cache
+// misses and branch misses over the simulation loop.
+#ifdef PROFILE
+
+#include <chrono>
+
+#define NUM_COUNTERS 4
+
+class Profiler {
+ public:
+  bool enabled;
+
+  Profiler();
+  void enable(int);
+  void start_phase(ProfilePhase);
+  void end_phase(ProfilePhase);
+  void start_counters(int);
+  void stop_counters(int);
+  void start_sim(int t) {
+    if (enabled)
+      threads[t].sim_start = std::chrono::steady_clock::now();
+  }
+  void end_sim(int t, int n) {
+    if (enabled) {
+      threads[t].busy += std::chrono::steady_clock::now() - threads[t].sim_start;
+      threads[t].sims += n;
+    }
+  }
+  void print(FILE* = stdout);
+
+ private:
+  struct alignas(CACHE_LINE) ThreadProfile {
+    std::chrono::steady_clock::time_point sim_start;
+    std::chrono::steady_clock::duration busy;
+    int64_t sims;
+    int fds[NUM_COUNTERS];  // Counter file descriptors while counting, or -1
+    uint64_t counts[NUM_COUNTERS];
+  };
+
+  std::chrono::steady_clock::time_point phase_start[NUM_PHASES];
+  std::chrono::steady_clock::duration phase_time[NUM_PHASES];
+  std::vector<ThreadProfile> threads;
+};
+
+extern Profiler profiler;
+
+#define PROFILE_PHASE_BEGIN(phase) profiler.start_phase(phase)
+#define PROFILE_PHASE_END(phase) profiler.end_phase(phase)
+#define PROFILE_SIM_BEGIN(t) profiler.start_sim(t)
+#define PROFILE_SIM_END(t, n) profiler.end_sim(t, n)
+#define PROFILE_REPORT() profiler.print()
+
+#else
+
+#define PROFILE_PHASE_BEGIN(phase)
+#define PROFILE_PHASE_END(phase)
+#define PROFILE_SIM_BEGIN(t)
+#define PROFILE_SIM_END(t, n)
+#define PROFILE_REPORT()
+
+#endif
+
+#endif
@@ -0,0 +1,39 @@
+#ifndef RANDOM_H
+#define RANDOM_H
+
+#include <cstdint>
+
+// Counter-based random number stream. Each simulation gets its own stream,
+// keyed by the run seed and the simulation number, and each draw is a pure
+// function of that key and a counter (the index of the set in the bracket
+// program). Results therefore depend only on the seed, not on which thread
+// ran a simulation or in what order. The mixing function is the SplitMix64
+// finalizer, so a stream is equivalent to a SplitMix64 sequence.
+class RandomStream {
+ public:
+  RandomStream() {
+    key = 0;
+  }
+
+  RandomStream(uint64_t seed, uint64_t sim) {
+    key = mix(seed + (sim + 1) * gamma);
+  }
+
+  // Return a random float in [0, 1) for the given counter. The top 24 bits
+  // are converted through a signed 32-bit integer, which vectorizes.
+  float uniform(uint64_t counter) const {
+    return (int32_t) (mix(key + (counter + 1) * gamma) >> 40) * 0x1.0p-24f;
+  }
+
+  static uint64_t mix(uint64_t z) {
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return z ^ (z >> 31);
+  }
+
+ private:
+  static const uint64_t gamma = 0x9E3779B97F4A7C15ULL;
+  uint64_t key;
+};
+
+#endif
@@ -0,0 +1,325 @@
+#include "Scenario.hpp"
+
+// Scenario batch constructor
+ScenarioBatch::ScenarioBatch(std::vector<Bracket*> b, std::vector<LockstepEngine*> e) {
+  brackets = b;
+  engines = e;
+  num_players = brackets[0]->players_in_bracket.size();
+  num_placings = brackets[0]->num_rounds_P;
+
+  int num_threads = brackets.size();
+  excluded.resize(num_threads);
+  replayed.resize(num_threads);
+  num_disagreeing.resize(num_threads);
+  baseline_seats.assign(num_threads,
+                        std::vector<int>(brackets[0]->placing_seats.size() * LANES));
+  baseline_results.assign(num_threads,
+                          std::vector<int>(brackets[0]->program.size() * LANES));
+  saved_results.assign(num_threads, std::vector<int>(brackets[0]->program.size()));
+}
+
+// Add a scenario, dropping results that are already fixed
+void ScenarioBatch::add_scenario(std::string label, std::vector<std::pair<int, int>> overlay) {
+  Bracket* bracket = brackets[0];
+  std::vector<int> occupants = bracket->known_occupants();
+  Scenario scenario;
+  scenario.label = label;
+  scenario.conditioned = true;
+  for (int i = 0; i < overlay.size(); i++) {
+    if (bracket->program[overlay[i].first].result_fixed == overlay[i].second)
+      continue;
+    scenario.overlay.push_back(overlay[i]);
+    if (!bracket->is_pending(overlay[i].first, occupants))
+      scenario.conditioned = false;
+  }
+  scenarios.push_back(scenario);
+
+  int size = num_players * num_placings;
+  for (int t = 0; t < brackets.size(); t++) {
+    excluded[t].push_back(std::vector<int64_t>(size));
+    replayed[t].push_back(std::vector<int64_t>(size));
+    num_disagreeing[t].push_back(0);
+  }
+}
+
+// Load scenarios from a file, one per line, each a comma-separated list of
+// results such as "W3#5 = 2, L4#1 = 1". "pending" instead gives two scenarios
+// for every pending set, one for each result.
+void ScenarioBatch::load(std::string fname) {
+  Bracket* bracket = brackets[0];
+  if (fname == "pending") {
+    std::vector<int> occupants = bracket->known_occupants();
+    for (int k = 0; k < bracket->program.size(); k++) {
+      if (!bracket->is_pending(k, occupants))
+        continue;
+      const MatchOp& op = bracket->program[k];
+      std::string name_1 = bracket->players_in_bracket[occupants[op.seat]]->name;
+      std::string name_2 = bracket->players_in_bracket[occupants[op.seat + 1]]->name;
+      std::string address = bracket->match_address(k);
+      add_scenario(address + " = 1 (" + name_1 + " beats " + name_2 + ")",
+                   {std::make_pair(k, 1)});
+      add_scenario(address + " = 2 (" + name_2 + " beats " + name_1 + ")",
+                   {std::make_pair(k, 2)});
+    }
+    if (scenarios.empty())
+      throw_error("No sets are pending");
+    return;
+  }
+
+  std::ifstream infile = open_file(fname);
+  std::string line;
+  while (std::getline(infile, line)) {
+    line.erase(0, line.find_first_not_of(" \t"));
+    line.erase(line.find_last_not_of(" \t\r") + 1);
+    if (line.empty())
+      continue;
+    std::vector<std::pair<int, int>> overlay;
+    std::istringstream iss(line);
+    std::string item;
+    while (std::getline(iss, item, ',')) {
+      int result;
+      int op = bracket->parse_result(item, result);
+      if (op < 0)
+        throw_error("Unable to read result \"" + item + "\" in " + fname);
+      overlay.push_back(std::make_pair(op, result));
+    }
+    add_scenario(line, overlay);
+  }
+  if (scenarios.empty())
+    throw_error("No scenarios found in " + fname);
+}
+
+// Return whether a simulation's results agree with a scenario's overlay
+bool ScenarioBatch::agrees(const Scenario& scenario, const int* results, int stride) {
+  for (int i = 0; i < scenario.overlay.size(); i++)
+    if (results[scenario.overlay[i].first * stride] != scenario.overlay[i].second)
+      return false;
+  return true;
+}
+
+// Count the placings of a simulation, given the players in the placing seats
+void ScenarioBatch::add_placings(std::vector<int64_t>& counts, const int* occupants, int stride) {
+  std::vector<PlacingSeat>& placing_seats = brackets[0]->placing_seats;
+  for (int p = 0; p < placing_seats.size(); p++)
+    counts[occupants[p * stride] * num_placings + placing_seats[p].placing] += 1;
+}
+
+// Impose a scenario's results on a thread's bracket, saving those they replace
+void ScenarioBatch::set_overlay(int t, const Scenario& scenario, std::vector<int>& saved) {
+  std::vector<MatchOp>& program = brackets[t]->program;
+  saved.resize(scenario.overlay.size());
+  for (int i = 0; i < scenario.overlay.size(); i++) {
+    saved[i] = program[scenario.overlay[i].first].result_fixed;
+    program[scenario.overlay[i].first].result_fixed = scenario.overlay[i].second;
+  }
+}
+
+// Restore the results replaced by set_overlay
+void ScenarioBatch::clear_overlay(int t, const Scenario& scenario, const std::vector<int>& saved) {
+  std::vector<MatchOp>& program = brackets[t]->program;
+  for (int i = scenario.overlay.size() - 1; i >= 0; i--)
+    program[scenario.overlay[i].first].result_fixed = saved[i];
+}
+
+// Run simulation i as the baseline and for every scenario, on thread t
+void ScenarioBatch::simulate(int t, uint64_t seed, uint64_t i) {
+  Bracket* bracket = brackets[t];
+  RandomStream rng(seed, i);
+  bracket->simulate(rng);
+
+  // Replaying a scenario overwrites the bracket's seats and results, so keep
+  // the baseline's
+  std::vector<int>& seats = baseline_seats[t];
+  std::vector<int>& results = baseline_results[t];
+  for (int p = 0; p < bracket->placing_seats.size(); p++)
+    seats[p] = bracket->seats[bracket->placing_seats[p].seat];
+  std::copy(bracket->results.begin(), bracket->results.end(), results.begin());
+
+  std::vector<int>& saved = saved_results[t];
+  for (int s = 0; s < scenarios.size(); s++) {
+    const Scenario& scenario = scenarios[s];
+    if (agrees(scenario, results.data(), 1))
+      continue;
+    num_disagreeing[t][s]++;
+    add_placings(excluded[t][s], seats.data(), 1);
+    if (!scenario.conditioned) {
+      set_overlay(t, scenario, saved);
+      bracket->play(rng);
+      for (int p = 0; p < bracket->placing_seats.size(); p++)
+        replayed[t][s][bracket->seats[bracket->placing_seats[p].seat] * num_placings +
+                       bracket->placing_seats[p].placing] += 1;
+      clear_overlay(t, scenario, saved);
+    }
+  }
+}
+
+// Run a block of simulations on the lockstep engine of thread t, as the
+// baseline and for every scenario
+void ScenarioBatch::simulate_block(int t, uint64_t seed, uint64_t first_sim, int num_sims) {
+  LockstepEngine* engine = engines[t];
+  std::vector<PlacingSeat>& placing_seats = brackets[t]->placing_seats;
+  engine->simulate(seed, first_sim, num_sims);
+
+  std::vector<int>& seats = baseline_seats[t];
+  std::vector<int>& results = baseline_results[t];
+  for (int p = 0; p < placing_seats.size(); p++)
+    for (int l = 0; l < LANES; l++)
+      seats[p * LANES + l] = engine->seats[placing_seats[p].seat * LANES + l];
+  std::copy(engine->results.begin(), engine->results.end(), results.begin());
+
+  std::vector<int>& saved = saved_results[t];
+  for (int s = 0; s < scenarios.size(); s++) {
+    const Scenario& scenario = scenarios[s];
+    bool disagrees[LANES];
+    bool any = false;
+    for (int l = 0; l < num_sims; l++) {
+      disagrees[l] = !agrees(scenario, results.data() + l, LANES);
+      if (disagrees[l]) {
+        any = true;
+        num_disagreeing[t][s]++;
+        add_placings(excluded[t][s], seats.data() + l, LANES);
+      }
+    }
+    if (!any || scenario.conditioned)
+      continue;
+
+    // Every lane of the block is replayed; lanes that agree play out as before
+    set_overlay(t, scenario, saved);
+    engine->play(seed, first_sim);
+    for (int p = 0; p < placing_seats.size(); p++)
+      for (int l = 0; l < num_sims; l++)
+        if (disagrees[l])
+          replayed[t][s][engine->seats[placing_seats[p].seat * LANES + l] * num_placings +
+                         placing_seats[p].placing] += 1;
+    clear_overlay(t, scenario, saved);
+  }
+}
+
+// Print the change in every player's odds under each scenario. The baseline
+// placings must already be merged into thread 0's players.
+void ScenarioBatch::print(int64_t n) {
+  std::vector<Player*>& players = brackets[0]->players_in_bracket;
+  int num_rounds_P = brackets[0]->num_rounds_P;
+
+  for (int s = 0; s < scenarios.size(); s++) {
+    const Scenario& scenario = scenarios[s];
+    int64_t m = 0;
+    std::vector<int64_t> excl(num_players * num_placings), repl(num_players * num_placings);
+    for (int t = 0; t < brackets.size(); t++) {
+      m += num_disagreeing[t][s];
+      for (int x = 0; x < excl.size(); x++) {
+        excl[x] += excluded[t][s][x];
+        repl[x] += replayed[t][s][x];
+      }
+    }
+
+    // Conditioned scenarios use only the agreeing simulations; the others
+    // replace the disagreeing ones with their replays
+    printf("Scenario %d: %s\n", s + 1, scenario.label.c_str());
+    int64_t num_sims = scenario.conditioned ? n - m : n;
+    if (scenario.conditioned)
+      printf("Based on the %" PRId64 " of %" PRId64 " simulations with these results\n",
+             num_sims, n);
+    else
+      printf("Replayed %" PRId64 " of %" PRId64 " simulations\n", m, n);
+    if (num_sims == 0) {
+      printf("\n");
+      continue;
+    }
+
+    std::vector<std::vector<double>> prob(num_players, std::vector<double>(num_placings));
+    for (int i = 0; i < num_players; i++)
+      for (int j = 0; j < num_placings; j++) {
+        int x = i * num_placings + j;
+        prob[i][j] = (players[i]->placings[j] - excl[x] + repl[x]) / (double) num_sims;
+      }
+    print_changes(players, num_rounds_P, n, prob);
+    printf("\n");
+  }
+}
+
+// Print players' points and placing probabilities under a change to the
+// bracket, given as probabilities [player][placing], with the differences from
+// the placings of the players (out of n simulations). Players whose odds do not
+// change are left out.
+void print_changes(std::vector<Player*>& players, int num_rounds_P, int64_t n,
+                   const std::vector<std::vector<double>>& prob) {
+  std::vector<std::pair<double, int>> order;
+  for (int i = 0; i < players.size(); i++) {
+    double points = 0., p = 100.;
+    for (int j = 0; j < prob[i].size(); j++) {
+      points += prob[i][j] * p;
+      p *= 0.75;
+    }
+    order.push_back(std::make_pair(-points, i));
+  }
+  std::sort(order.begin(), order.end());
+
+  printf("  %-16s%9s%9s", "Name", "Points", "Change");
+  for (int j = 0; j < num_rounds_P; j++)
+    printf("%9s", get_ordinal(get_placing(j)).c_str());
+  printf("\n");
+  printf("  %s\n", std::string(34 + 9 * num_rounds_P, '-').c_str());
+  int num_unchanged = 0;
+  for (int k = 0; k < players.size(); k++) {
+    int i = order[k].second;
+    double points = -order[k].first;
+    std::vector<double> change(num_rounds_P);
+    bool changed = fabs(points - players[i]->avg_points) >= 0.005;
+    for (int j = 0; j < num_rounds_P; j++) {
+      change[j] = 100. * (prob[i][j] - players[i]->placings[j] / (double) n);
+      changed = changed || fabs(change[j]) >= 0.005;
+    }
+    if (!changed) {
+      num_unchanged++;
+      continue;
+    }
+    printf("  %-16s  %7.2f  %+7.2f", players[i]->name.c_str(), points,
+           points - players[i]->avg_points);
+    for (int j = 0; j < num_rounds_P; j++)
+      printf("  %+7.2f", change[j]);
+    printf("\n");
+  }
+  if (num_unchanged > 0)
+    printf("  (%d players unchanged)\n", num_unchanged);
+}
+
+// Print the odds conditional on each result of each stratified set. The
+// placings must already be merged into thread 0's bracket.
+void print_strata(Bracket* bracket, int64_t n) {
+  std::vector<Player*>& players = bracket->players_in_bracket;
+  int num_strata = bracket->strata.size();
+  int num_placings = bracket->num_strata_placings;
+  std::vector<int> occupants = bracket->known_occupants();
+
+  for (int m = 0; m < num_strata; m++) {
+    const MatchOp& op = bracket->program[bracket->strata[m]];
+    for (int r = 1; r <= 2; r++) {
+      // Exactly one player places first in every simulation
+      std::vector<std::vector<double>> prob(players.size(), std::vector<double>(num_placings));
+      int64_t num_sims = 0;
+      for (int i = 0; i < players.size(); i++)
+        num_sims += bracket->strata_placings[(i * num_placings * 2 + r - 1) * num_strata + m];
+
+      std::string label = bracket->match_address(bracket->strata[m]) + " = " + std::to_string(r);
+      int id_1 = occupants[op.seat + r - 1];
+      int id_2 = occupants[op.seat + 2 - r];
+      if (id_1 >= 0 && id_2 >= 0)
+        label += " (" + players[id_1]->name + " beats " + players[id_2]->name + ")";
+      printf("Given %s\n", label.c_str());
+      printf("In %" PRId64 " of %" PRId64 " simulations (%.2f%%)\n", num_sims, n,
+             100. * num_sims / n);
+      if (num_sims == 0) {
+        printf("\n");
+        continue;
+      }
+
+      for (int i = 0; i < players.size(); i++)
+        for (int j = 0; j < num_placings; j++)
+          prob[i][j] = bracket->strata_placings[(((i * num_placings + j) * 2 + r - 1) *
+                                                 num_strata) + m] / (double) num_sims;
+      print_changes(players, bracket->num_rounds_P, n, prob);
+      printf("\n");
+    }
+  }
+}
@@ -0,0 +1,60 @@
+#ifndef SCENARIO_H
+#define SCENARIO_H
+
+#include "Bracket.hpp"
+#include "Lockstep.hpp"
+
+// A what-if scenario: results imposed on top of those already fixed
+struct Scenario {
+  std::string label;
+  std::vector<std::pair<int, int>> overlay;  // (op, result)
+  bool conditioned;  // Every set of the overlay is pending
+};
+
+// Batch of what-if scenarios simulated alongside the baseline bracket, with
+// common random numbers. Every simulation is run once as the baseline; a
+// scenario only needs work in the simulations where the baseline disagrees
+// with its overlay, since in the others the scenario plays out identically.
+//
+// When every set of a scenario is pending (both players known and the result
+// not), forcing its result is the same as conditioning on it, so the scenario
+// is estimated from the baseline simulations that agree with it, at no extra
+// cost. Otherwise, the disagreeing simulations are replayed with the overlay
+// and the same random numbers. Sweeping both results of every pending set
+// therefore costs about one run.
+class ScenarioBatch {
+ public:
+  std::vector<Bracket*> brackets;
+  std::vector<LockstepEngine*> engines;
+  std::vector<Scenario> scenarios;
+
+  ScenarioBatch(std::vector<Bracket*>, std::vector<LockstepEngine*>);
+  void load(std::string);
+  void simulate(int, uint64_t, uint64_t);
+  void simulate_block(int, uint64_t, uint64_t, int);
+  void print(int64_t);
+
+ private:
+  int num_players, num_placings;
+  // Per thread, [scenario][player * num_placings + placing]: baseline placings
+  // of disagreeing simulations, and their replayed placings
+  std::vector<std::vector<std::vector<int64_t>>> excluded, replayed;
+  std::vector<std::vector<int64_t>> num_disagreeing;  // [thread][scenario]
+
+  // Per thread, the baseline simulation(s) being worked on: who occupied each
+  // placing seat and the result of each set, [index][lane]
+  std::vector<std::vector<int>> baseline_seats, baseline_results;
+  std::vector<std::vector<int>> saved_results;  // Results replaced by a replayed overlay
+
+  void add_scenario(std::string, std::vector<std::pair<int, int>>);
+  bool agrees(const Scenario&, const int*, int);
+  void add_placings(std::vector<int64_t>&, const int*, int);
+  void set_overlay(int, const Scenario&, std::vector<int>&);
+  void clear_overlay(int, const Scenario&, const std::vector<int>&);
+};
+
+void print_changes(std::vector<Player*>&, int, int64_t, const std::vector<std::vector<double>>&);
+
+void print_strata(Bracket*, int64_t);
+
+#endif
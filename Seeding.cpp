@@ -0,0 +1,195 @@
+#include "Seeding.hpp"
+
+#include <chrono>
+
+struct by_rating_orig {
+  bool operator()(Player* p1, Player* p2) {
+    return p1->rating_orig > p2->rating_orig;
+  }
+};
+
+// Seeding optimizer constructor. Every candidate seeding is scored with the
+// same n simulations; the top num_top players by rating are the seeds whose
+// expected points are maximized.
+SeedingOptimizer::SeedingOptimizer(std::vector<Bracket*> b, std::vector<LockstepEngine*> e,
+                                   int64_t num_sims, uint64_t s, int num_top) {
+  brackets = b;
+  engines = e;
+  n = num_sims;
+  seed = s;
+
+  std::vector<Player*> players = brackets[0]->players_in_bracket;
+  std::stable_sort(players.begin(), players.end(), by_rating_orig());
+  for (int i = 0; i < (std::min)(num_top, (int) players.size()); i++)
+    top_seeds.push_back(std::find(brackets[0]->players_in_bracket.begin(),
+                                  brackets[0]->players_in_bracket.end(), players[i]) -
+                        brackets[0]->players_in_bracket.begin());
+
+  sides = brackets[0]->initial_seats_W;
+  num_W = sides.size();
+  sides.insert(sides.end(), brackets[0]->initial_seats_L.begin(),
+               brackets[0]->initial_seats_L.end());
+  num_candidates = 0;
+  num_accepted = 0;
+  seconds = 0.;
+}
+
+// Simulate the current seeding n times and return the summed expected points
+// of the top seeds, along with every player's expected points
+double SeedingOptimizer::evaluate(std::vector<float>& points) {
+  int num_threads = brackets.size();
+  for (int t = 0; t < num_threads; t++)
+    brackets[t]->clear_placings();
+
+  if (engines[0] != NULL) {
+    int64_t num_blocks = (n + LANES - 1) / LANES;
+    #pragma omp parallel for schedule(guided)
+    for (int64_t b = 0; b < num_blocks; b++)
+      engines[THREAD_NUM]->simulate(seed, (uint64_t) b * LANES,
+                                    (std::min)((int64_t) LANES, n - b * LANES));
+  } else {
+    #pragma omp parallel for schedule(guided)
+    for (int64_t i = 0; i < n; i++)
+      brackets[THREAD_NUM]->simulate(RandomStream(seed, i));
+  }
+  merge_placings(brackets);
+
+  std::vector<Player*>& players = brackets[0]->players_in_bracket;
+  points.resize(players.size());
+  for (int i = 0; i < players.size(); i++)
+    points[i] = players[i]->avg_points;
+  double score = 0.;
+  for (int i = 0; i < top_seeds.size(); i++)
+    score += points[top_seeds[i]];
+  return score;
+}
+
+// Swap the players in two initial seats, in every thread's bracket and engine
+void SeedingOptimizer::swap_seats(int a, int b) {
+  for (int t = 0; t < brackets.size(); t++) {
+    std::swap(brackets[t]->seats[a], brackets[t]->seats[b]);
+    if (engines[t] != NULL)
+      engines[t]->swap_seats(a, b);
+  }
+}
+
+// Return whether two players (not byes) on a side of the bracket, given by
+// the range of initial seats, are in different sets
+bool SeedingOptimizer::can_swap(int first, int size) {
+  int first_set = -1;
+  for (int i = 0; i < size; i++)
+    if (sides[first + i] >= 0) {
+      if (first_set >= 0 && i / 2 != first_set)
+        return true;
+      if (first_set < 0)
+        first_set = i / 2;
+    }
+  return false;
+}
+
+// Simulated annealing over swaps of two players on the same side of the
+// bracket, from the seeding in initial_bracket.txt. Swaps within a set are
+// skipped, since they leave the bracket unchanged. The temperature cools
+// geometrically from 1% to 0.001% of the initial score.
+void SeedingOptimizer::optimize(int num_iterations) {
+  std::chrono::high_resolution_clock::time_point start, end;
+  start = std::chrono::high_resolution_clock::now();
+
+  std::vector<float> points;
+  double score = evaluate(points);
+  initial_score = best_score = score;
+  initial_points = best_points = points;
+  best_seats.resize(sides.size());
+  for (int i = 0; i < sides.size(); i++)
+    best_seats[i] = sides[i] < 0 ? -1 : brackets[0]->seats[sides[i]];
+
+  int num_L = sides.size() - num_W;
+  std::vector<MatchOp>& program = brackets[0]->program;
+  for (int k = 0; k < program.size(); k++)
+    if (program[k].result_fixed != 0) {
+      throw_warning("Some results are fixed; they stay with their sets as the players move");
+      break;
+    }
+  bool swap_W = can_swap(0, num_W), swap_L = can_swap(num_W, num_L);
+  if (!swap_W && !swap_L)
+    throw_error("There are no two sets on the same side of the bracket to swap players between");
+
+  // The random numbers of the search are kept apart from the simulations'
+  RandomStream stream(~seed, 0);
+  double T_0 = 0.01 * (std::max)(initial_score, 1.);
+  double cooling = num_iterations > 1 ? pow(1.e-3, 1. / (num_iterations - 1)) : 1.;
+  double T = T_0;
+  uint64_t counter = 0;
+  for (int it = 0; it < num_iterations; it++, T *= cooling) {
+    // Pick a side in proportion to its seats, then two players (not byes) in
+    // different sets
+    int first = 0, size = num_W;
+    if (!swap_W || (swap_L && stream.uniform(counter++) * sides.size() >= num_W)) {
+      first = num_W;
+      size = num_L;
+    }
+    int i, j;
+    do {
+      i = (std::min)((int) (stream.uniform(counter++) * size), size - 1);
+      j = (std::min)((int) (stream.uniform(counter++) * size), size - 1);
+    } while (i / 2 == j / 2 || sides[first + i] < 0 || sides[first + j] < 0);
+    int a = sides[first + i], b = sides[first + j];
+
+    swap_seats(a, b);
+    double candidate = evaluate(points);
+    num_candidates++;
+    if (candidate >= score || stream.uniform(counter++) < exp((candidate - score) / T)) {
+      score = candidate;
+      num_accepted++;
+      if (score > best_score) {
+        best_score = score;
+        best_points = points;
+        for (int k = 0; k < sides.size(); k++)
+          best_seats[k] = sides[k] < 0 ? -1 : brackets[0]->seats[sides[k]];
+      }
+    } else {
+      swap_seats(a, b);
+    }
+  }
+
+  end = std::chrono::high_resolution_clock::now();
+  seconds = std::chrono::duration_cast<std::chrono::microseconds>(end - start).count() * 1.e-6;
+}
+
+// Print the top seeds' expected points before and after, and the best seeding
+// found, in the format of initial_bracket.txt (also written to a file if one
+// is given)
+void SeedingOptimizer::print(std::string fname) {
+  std::vector<Player*>& players = brackets[0]->players_in_bracket;
+  printf("  %-20s%10s%10s%10s\n", "Top seed", "Initial", "Best", "Change");
+  printf("  %s\n", std::string(50, '-').c_str());
+  for (int i = 0; i < top_seeds.size(); i++) {
+    int id = top_seeds[i];
+    printf("  %-20s%10.2f%10.2f%+10.2f\n", players[id]->name.c_str(), initial_points[id],
+           best_points[id], best_points[id] - initial_points[id]);
+  }
+  printf("  %s\n", std::string(50, '-').c_str());
+  printf("  %-20s%10.2f%10.2f%+10.2f\n\n", "Total", initial_score, best_score,
+         best_score - initial_score);
+
+  std::string seeding;
+  for (int i = 0; i < sides.size(); i++) {
+    if (i == num_W)
+      seeding += "\n";
+    seeding += (best_seats[i] < 0 ? BYE : players[best_seats[i]]->name) + "\n";
+  }
+  seeding += "\n";
+  printf("Best seeding:\n%s", seeding.c_str());
+
+  if (!fname.empty()) {
+    FILE* out = fopen(fname.c_str(), "w");
+    if (out == NULL)
+      throw_error("Unable to write " + fname);
+    fprintf(out, "%s", seeding.c_str());
+    fclose(out);
+  }
+
+  printf("%d candidates of %" PRId64 " simulations each (%d accepted) in %g seconds; "
+         "%.0f candidates per minute\n", num_candidates, n, num_accepted, seconds,
+         60. * (num_candidates + 1) / seconds);
+}
@@ -0,0 +1,40 @@
+#ifndef SEEDING_H
+#define SEEDING_H
+
+#include "Bracket.hpp"
+#include "Lockstep.hpp"
+
+// Seeding optimizer. Searches over the order of initial_bracket.txt for the
+// seeding that maximizes the expected points of the top seeds (the players
+// with the highest ratings), by simulated annealing over swaps of two players
+// on the same side of the bracket. A swap only exchanges two initial seats in
+// the brackets (and engines) already built, and every candidate is scored with
+// the same n simulations (common random numbers), so differences in score are
+// due to the seeding rather than to chance.
+class SeedingOptimizer {
+ public:
+  std::vector<Bracket*> brackets;
+  std::vector<LockstepEngine*> engines;
+  std::vector<int> top_seeds;  // Player IDs
+
+  SeedingOptimizer(std::vector<Bracket*>, std::vector<LockstepEngine*>, int64_t, uint64_t, int);
+  void optimize(int);
+  void print(std::string);
+
+ private:
+  int64_t n;
+  uint64_t seed;
+  std::vector<int> sides;  // Initial seats, winners bracket then losers bracket
+  int num_W;
+  std::vector<float> initial_points, best_points;
+  double initial_score, best_score;
+  std::vector<int> best_seats;  // Player ID in each of sides
+  int num_candidates, num_accepted;
+  double seconds;
+
+  double evaluate(std::vector<float>&);
+  void swap_seats(int, int);
+  bool can_swap(int, int);
+};
+
+#endif
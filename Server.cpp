@@ -0,0 +1,196 @@
+#include <chrono>
+
+#ifdef __linux__
+#include <csignal>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+#include "Server.hpp"
+
+// Odds server constructor; starts simulating straight away
+OddsServer::OddsServer(std::vector<Bracket*> b, std::vector<LockstepEngine*> e,
+                       bool ls, int64_t num_sims, uint64_t s) {
+  brackets = b;
+  engines = e;
+  lockstep = ls;
+  n = num_sims;
+  seed = s;
+  cancel = false;
+  stopping = false;
+  num_updates = 0;
+  snapshot_updates = -1;
+  snapshot_version = 0;
+  snapshot_seconds = 0.;
+  worker = std::thread(&OddsServer::run, this);
+}
+
+// Odds server destructor
+OddsServer::~OddsServer() {
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    stopping = true;
+    cancel = true;
+  }
+  changed.notify_all();
+  worker.join();
+}
+
+// Run the simulations whenever there are results not yet included in the
+// snapshot. Every round uses the same seed, so the change between two tables
+// is due to the new results rather than to sampling noise.
+void OddsServer::run() {
+  std::unique_lock<std::mutex> lock(mutex);
+  while (true) {
+    changed.wait(lock, [this] { return stopping || snapshot_updates < num_updates; });
+    if (stopping)
+      return;
+
+    for (int i = 0; i < pending.size(); i++)
+      for (int t = 0; t < brackets.size(); t++)
+        brackets[t]->program[pending[i].first].result_fixed = pending[i].second;
+    pending.clear();
+    int updates = num_updates;
+    cancel = false;
+    lock.unlock();
+
+    std::chrono::high_resolution_clock::time_point start, end;
+    start = std::chrono::high_resolution_clock::now();
+    bool completed = simulate_all();
+    end = std::chrono::high_resolution_clock::now();
+
+    lock.lock();
+    if (completed) {
+      snapshot.clear();
+      std::vector<Player*>& players = brackets[0]->players_in_bracket;
+      for (int i = 0; i < players.size(); i++)
+        snapshot.push_back(*players[i]);
+      snapshot_updates = updates;
+      snapshot_version++;
+      snapshot_seconds = std::chrono::
+                         duration_cast<std::chrono::microseconds>(end - start).count() * 1.e-6;
+      changed.notify_all();
+    }
+  }
+}
+
+// Simulate the bracket n times, returning false if cancelled by an update
+bool OddsServer::simulate_all() {
+  for (int t = 0; t < brackets.size(); t++)
+    brackets[t]->clear_placings();
+
+  if (lockstep) {
+    int64_t num_blocks = (n + LANES - 1) / LANES;
+    #pragma omp parallel for schedule(guided)
+    for (int64_t b = 0; b < num_blocks; b++) {
+      if (cancel)
+        continue;
+      int num_sims = (std::min)((int64_t) LANES, n - b * LANES);
+      engines[THREAD_NUM]->simulate(seed, (uint64_t) b * LANES, num_sims);
+    }
+  } else {
+    #pragma omp parallel for schedule(guided)
+    for (int64_t i = 0; i < n; i++) {
+      if (cancel)
+        continue;
+      brackets[THREAD_NUM]->simulate(RandomStream(seed, i));
+    }
+  }
+  if (cancel)
+    return false;
+
+  merge_placings(brackets);
+  return true;
+}
+
+// Print the snapshot; the mutex must be held
+void OddsServer::print_snapshot(FILE* out) {
+  std::vector<Player*> players;
+  for (int i = 0; i < snapshot.size(); i++)
+    players.push_back(&snapshot[i]);
+  print_results(players, brackets[0]->num_rounds_P, out);
+  fprintf(out, "Snapshot %d: %" PRId64 " simulations with %d of %d updates, taking %.3f seconds\n",
+          snapshot_version, n, snapshot_updates, num_updates, snapshot_seconds);
+  fprintf(out, "END\n");
+}
+
+// Handle one command, returning false when the connection should be closed,
+// or can no longer be written to
+bool OddsServer::handle(const std::string& line, FILE* out) {
+  std::istringstream iss(line);
+  std::string command;
+  iss >> command;
+
+  if (command == "match") {
+    int result;
+    std::string rest;
+    std::getline(iss, rest);
+    int op = brackets[0]->parse_result(rest, result);
+    if (op < 0) {
+      fprintf(out, "ERROR unknown set or result; expected e.g. match W3#5 = 2\n");
+    } else {
+      std::lock_guard<std::mutex> lock(mutex);
+      pending.push_back(std::make_pair(op, result));
+      num_updates++;
+      cancel = true;
+      changed.notify_all();
+      fprintf(out, "OK %s = %d, update %d\n",
+              brackets[0]->match_address(op).c_str(), result, num_updates);
+    }
+  } else if (command == "odds" || command == "wait") {
+    std::unique_lock<std::mutex> lock(mutex);
+    int target = command == "wait" ? num_updates : 0;
+    changed.wait(lock, [this, target] { return stopping || snapshot_updates >= target; });
+    print_snapshot(out);
+  } else if (command == "quit") {
+    return false;
+  } else if (!command.empty()) {
+    fprintf(out, "ERROR unknown command %s\n", command.c_str());
+  }
+  return fflush(out) == 0 && !ferror(out);
+}
+
+// Answer commands from a stream until it ends or is told to quit
+void OddsServer::serve(FILE* in, FILE* out) {
+  char buffer[1024];
+  while (fgets(buffer, sizeof(buffer), in) != NULL)
+    if (!handle(buffer, out))
+      break;
+}
+
+// Answer commands from clients connecting to a Unix socket, each on its own
+// thread
+void OddsServer::serve_socket(std::string path) {
+#ifdef __linux__
+  int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  struct sockaddr_un addr = {};
+  addr.sun_family = AF_UNIX;
+  if (fd < 0 || path.size() >= sizeof(addr.sun_path))
+    throw_error("Unable to create socket " + path);
+  strcpy(addr.sun_path, path.c_str());
+  unlink(path.c_str());
+  if (bind(fd, (struct sockaddr*) &addr, sizeof(addr)) < 0 || listen(fd, 16) < 0)
+    throw_error("Unable to listen on socket " + path);
+  print_status_msg(2, "Listening on " + path);
+
+  // A client that disconnects before reading its reply would otherwise kill
+  // the server with SIGPIPE; the failed write ends that client's thread instead
+  signal(SIGPIPE, SIG_IGN);
+
+  while (true) {
+    int client = accept(fd, NULL, NULL);
+    if (client < 0)
+      continue;
+    std::thread([this, client] {
+      FILE* in = fdopen(client, "r");
+      FILE* out = fdopen(dup(client), "w");
+      serve(in, out);
+      fclose(out);
+      fclose(in);
+    }).detach();
+  }
+#else
+  throw_error("Sockets are only supported on Linux; use stdin instead");
+#endif
+}
@@ -0,0 +1,59 @@
+#ifndef SERVER_H
+#define SERVER_H
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+#include "Bracket.hpp"
+#include "Lockstep.hpp"
+
+// Live odds server. Keeps the brackets built and in memory, and accepts the
+// results of sets as they finish. Each update sets `result_fixed` on the
+// matching set of every bracket and starts a new round of simulations in a
+// background thread, cancelling any round still running. Queries are answered
+// from the last completed round (the snapshot), so they never wait for the
+// simulations unless asked to.
+//
+// Commands, one per line:
+//   match W3#5 = 2  set the result of a set (0 to clear it); the set is given
+//                   by side, round and index as numbered in bracket_params.txt
+//   odds            print the snapshot
+//   wait            print the snapshot once it includes every update so far
+//   quit            close the connection (or stop the server, on stdin)
+// Updates are answered with a line starting with OK or ERROR, and tables are
+// followed by a line containing END.
+class OddsServer {
+ public:
+  OddsServer(std::vector<Bracket*>, std::vector<LockstepEngine*>, bool, int64_t, uint64_t);
+  ~OddsServer();
+  void serve(FILE*, FILE*);
+  void serve_socket(std::string);
+
+ private:
+  std::vector<Bracket*> brackets;
+  std::vector<LockstepEngine*> engines;
+  bool lockstep;
+  int64_t n;
+  uint64_t seed;
+
+  std::thread worker;
+  std::mutex mutex;
+  std::condition_variable changed;
+  std::atomic<bool> cancel;
+  bool stopping;
+  std::vector<std::pair<int, int>> pending;  // (op, result) not yet applied
+  int num_updates;       // updates accepted
+  int snapshot_updates;  // updates included in the snapshot
+  int snapshot_version;  // number of completed rounds of simulations
+  double snapshot_seconds;
+  std::vector<Player> snapshot;
+
+  void run();
+  bool simulate_all();
+  bool handle(const std::string&, FILE*);
+  void print_snapshot(FILE*);
+};
+
+#endif
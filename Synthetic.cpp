@@ -0,0 +1,31 @@
+#include "Synthetic.hpp"
+
+// Generate a winners-only bracket of the given number of seats, with num_players
+// entrants, the last byes spread one per set from the top of the bracket. The
+// entrants P0, P1, ... are added to the database, rated from 2400 down to 1600.
+Bracket* generate_bracket(int num_seats, int num_players, PlayerDatabase& database) {
+  int num_rounds_W = (int) round(log2(num_seats));
+  std::vector<std::vector<int>> wl_map, res_fixed_W, res_fixed_L, res_fixed_G;
+  for (int rid = 1; rid < num_rounds_W; rid++) {
+    std::vector<int> row(int_power(2, rid));
+    for (int i = 0; i < row.size(); i++)
+      row[i] = rid == num_rounds_W - 1 ? i / 2 : row.size() - 1 - i;
+    wl_map.push_back(row);
+  }
+
+  std::vector<std::string> players_W, players_L;
+  int num_byes = num_seats - num_players;
+  for (int i = 0, p = 0; i < num_seats / 2; i++) {
+    players_W.push_back("P" + std::to_string(p++));
+    players_W.push_back(i < num_byes ? BYE : "P" + std::to_string(p++));
+  }
+  for (int p = 0; p < num_players; p++)
+    database.add("P" + std::to_string(p), 2400. - 800. * p / num_players, 60.);
+
+  Bracket* bracket = new Bracket(num_seats, 0);
+  bracket->set_player_database(&database);
+  bracket->set_structure(wl_map);
+  bracket->set_initial_players(players_W, players_L, 0);
+  bracket->set_res_fixed(res_fixed_W, res_fixed_L, res_fixed_G);
+  return bracket;
+}
@@ -0,0 +1,9 @@
+#ifndef SYNTHETIC_H
+#define SYNTHETIC_H
+
+#include "Bracket.hpp"
+
+// Synthetic brackets for the benchmarks
+Bracket* generate_bracket(int, int, PlayerDatabase&);
+
+#endif
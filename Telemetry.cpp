@@ -0,0 +1,138 @@
+#include "Telemetry.hpp"
+
+#ifdef __linux__
+#include <sys/ioctl.h>
+#include <unistd.h>
+#endif
+
+// Width of the rates printed after the progress bar
+#define RATES_WIDTH 36
+
+// Telemetry constructor, for num_threads threads running up to total
+// simulations, drawing a progress bar and/or writing JSON lines to a file (if
+// one is given)
+Telemetry::Telemetry(int num_threads, int64_t n, bool progress_bar, std::string fname)
+  : counts(num_threads) {
+  total = n;
+  bar = progress_bar;
+  json = NULL;
+  stopping = false;
+  if (!fname.empty()) {
+    json = fopen(fname.c_str(), "w");
+    if (json == NULL)
+      throw_error("Unable to write " + fname);
+  }
+
+  int columns = 80;
+#if defined _WIN32
+  CONSOLE_SCREEN_BUFFER_INFO csbi;
+  if (GetConsoleScreenBufferInfo(GetStdHandle(STD_OUTPUT_HANDLE), &csbi))
+    columns = csbi.srWindow.Right - csbi.srWindow.Left + 1;
+#elif defined __linux__
+  struct winsize console_size;
+  if (ioctl(STDOUT_FILENO, TIOCGWINSZ, &console_size) == 0 && console_size.ws_col > 0)
+    columns = console_size.ws_col;
+#endif
+  bar_width = (std::max)(columns - 9 - RATES_WIDTH, 10);
+}
+
+// Telemetry destructor
+Telemetry::~Telemetry() {
+  stop();
+  if (json != NULL)
+    fclose(json);
+}
+
+// Start the clock, and the reporter thread if there is anything to report
+void Telemetry::start() {
+  start_time = std::chrono::steady_clock::now();
+  if (bar || json != NULL)
+    reporter = std::thread(&Telemetry::run, this);
+}
+
+// Stop the reporter thread and make the final report, over the whole run
+void Telemetry::stop() {
+  if (!reporter.joinable())
+    return;
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    stopping = true;
+  }
+  stopped.notify_all();
+  reporter.join();
+
+  double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() -
+                                                 start_time).count();
+  std::vector<int64_t> now(counts.size()), zero(counts.size(), 0);
+  for (int t = 0; t < counts.size(); t++)
+    now[t] = count(t);
+  report(seconds, now, zero, seconds, true);
+}
+
+// Body of the reporter thread: sample the counters every TELEMETRY_INTERVAL
+// seconds until stopped
+void Telemetry::run() {
+  std::vector<int64_t> now(counts.size()), prev(counts.size(), 0);
+  double prev_seconds = 0.;
+  std::unique_lock<std::mutex> lock(mutex);
+  while (!stopped.wait_for(lock, std::chrono::duration<double>(TELEMETRY_INTERVAL),
+                           [this] { return stopping; })) {
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() -
+                                                   start_time).count();
+    for (int t = 0; t < counts.size(); t++)
+      now[t] = count(t);
+    report(seconds, now, prev, seconds - prev_seconds, false);
+    prev = now;
+    prev_seconds = seconds;
+  }
+}
+
+// Format a rate in simulations per second, e.g. 58.9k
+std::string format_rate(double rate) {
+  char buffer[16];
+  if (rate >= 1.e6)
+    snprintf(buffer, sizeof(buffer), "%.1fM", rate * 1.e-6);
+  else if (rate >= 1.e3)
+    snprintf(buffer, sizeof(buffer), "%.1fk", rate * 1.e-3);
+  else
+    snprintf(buffer, sizeof(buffer), "%.0f", rate);
+  return buffer;
+}
+
+// Report the simulations run so far, at the given time, and the rates over
+// the last interval, given the counts at its start
+void Telemetry::report(double seconds, const std::vector<int64_t>& now,
+                       const std::vector<int64_t>& prev, double interval, bool done) {
+  int num_threads = now.size();
+  int64_t sims = 0;
+  std::vector<double> rates(num_threads);
+  for (int t = 0; t < num_threads; t++) {
+    sims += now[t];
+    rates[t] = interval > 0. ? (now[t] - prev[t]) / interval : 0.;
+  }
+  double rate = 0.;
+  for (int t = 0; t < num_threads; t++)
+    rate += rates[t];
+
+  if (json != NULL) {
+    fprintf(json, "{\"seconds\":%.3f,\"sims\":%" PRId64 ",\"total\":%" PRId64 ",\"rate\":%.1f,"
+            "\"threads\":[", seconds, sims, total, rate);
+    for (int t = 0; t < num_threads; t++)
+      fprintf(json, t == 0 ? "%.1f" : ",%.1f", rates[t]);
+    fprintf(json, done ? "],\"done\":true}\n" : "]}\n");
+    fflush(json);
+  }
+
+  if (bar) {
+    double fraction = done ? 1. : (std::min)((double) sims / total, 1.);
+    int pos = fraction * bar_width;
+    std::string rates_text = " " + format_rate(rate) + "/s";
+    if (num_threads > 1)
+      rates_text += ", " + format_rate(*std::min_element(rates.begin(), rates.end())) + "-" +
+                    format_rate(*std::max_element(rates.begin(), rates.end())) + "/s per thread";
+    printf("[%s>%s] %3d%%%-*s%s", std::string(pos, '=').c_str(),
+           std::string(bar_width - pos, ' ').c_str(), (int) (100. * fraction), RATES_WIDTH,
+           rates_text.c_str(), done ? "\n\n" : "\r");
+    fflush(stdout);
+  }
+}
@@ -0,0 +1,55 @@
+#ifndef TELEMETRY_H
+#define TELEMETRY_H
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+#include "Bracket.hpp"
+
+// Seconds between two reports
+#define TELEMETRY_INTERVAL 0.5
+
+// Progress and throughput of a run. Each thread counts the simulations it has
+// finished in a counter on a cache line of its own, which only it writes (a
+// relaxed load and store, so no locked instruction in the loop). A reporter
+// thread samples the counters every TELEMETRY_INTERVAL seconds to draw a
+// progress bar with the overall and per-thread rates, and to append a line of
+// JSON per sample to a file, e.g.
+//   {"seconds":1.5,"sims":250000,"total":1000000,"rate":166000,"threads":[...]}
+// with the rates in simulations per second over the last interval. The final
+// line also has "done":true and the average rates over the whole run.
+class Telemetry {
+ public:
+  Telemetry(int, int64_t, bool, std::string);
+  ~Telemetry();
+  void start();
+  void stop();
+  void add(int t, int64_t n) {
+    std::atomic<int64_t>& count = counts[t].count;
+    count.store(count.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+  }
+  int64_t count(int t) {
+    return counts[t].count.load(std::memory_order_relaxed);
+  }
+
+ private:
+  std::vector<PaddedCount> counts;
+  int64_t total;
+  bool bar;
+  int bar_width;
+  FILE* json;
+
+  std::thread reporter;
+  std::mutex mutex;
+  std::condition_variable stopped;
+  bool stopping;
+  std::chrono::steady_clock::time_point start_time;
+
+  void run();
+  void report(double, const std::vector<int64_t>&, const std::vector<int64_t>&, double, bool);
+};
+
+#endif
@@ -0,0 +1,336 @@
+#include <zlib.h>
+
+#include "Trace.hpp"
+
+// Queue constructor, for up to capacity blocks (a power of 2)
+BlockQueue::BlockQueue(size_t capacity) : cells(new Cell[capacity]) {
+  mask = capacity - 1;
+  for (size_t i = 0; i < capacity; i++)
+    cells[i].sequence.store(i, std::memory_order_relaxed);
+  tail.store(0, std::memory_order_relaxed);
+  head.store(0, std::memory_order_relaxed);
+}
+
+// Push a block, returning false if the queue is full
+bool BlockQueue::push(TraceBlock* block) {
+  size_t pos = tail.load(std::memory_order_relaxed);
+  while (true) {
+    Cell& cell = cells[pos & mask];
+    size_t sequence = cell.sequence.load(std::memory_order_acquire);
+    if (sequence == pos) {
+      if (tail.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+        cell.block = block;
+        cell.sequence.store(pos + 1, std::memory_order_release);
+        return true;
+      }
+    } else if (sequence < pos) {
+      return false;  // Not yet popped on the last pass
+    } else {
+      pos = tail.load(std::memory_order_relaxed);
+    }
+  }
+}
+
+// Pop a block, returning NULL if the queue is empty
+TraceBlock* BlockQueue::pop() {
+  size_t pos = head.load(std::memory_order_relaxed);
+  while (true) {
+    Cell& cell = cells[pos & mask];
+    size_t sequence = cell.sequence.load(std::memory_order_acquire);
+    if (sequence == pos + 1) {
+      if (head.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+        TraceBlock* block = cell.block;
+        cell.sequence.store(pos + mask + 1, std::memory_order_release);
+        return block;
+      }
+    } else if (sequence < pos + 1) {
+      return NULL;  // Not yet pushed on this pass
+    } else {
+      pos = head.load(std::memory_order_relaxed);
+    }
+  }
+}
+
+// Round up to a power of 2
+static size_t ceil_power_of_2(size_t x) {
+  size_t y = 1;
+  while (y < x)
+    y *= 2;
+  return y;
+}
+
+// Trace writer constructor, for a bracket simulated by num_threads threads
+// with the given seed, writing to fname and compressing the blocks if asked
+TraceWriter::TraceWriter(Bracket* bracket, int num_threads, uint64_t seed, std::string fname,
+                         bool compress_blocks)
+  : full(ceil_power_of_2(num_threads * TRACE_BLOCKS_PER_THREAD)),
+    empty(ceil_power_of_2(num_threads * TRACE_BLOCKS_PER_THREAD)) {
+  compress = compress_blocks;
+  stopping = false;
+  for (int k = 0; k < bracket->program.size(); k++)
+    if (bracket->program[k].result_fixed == 0)
+      ops.push_back(k);
+  record_bytes = (ops.size() + 7) / 8;
+  block_sims = (std::max)(TRACE_BLOCK_BYTES / (std::max)(record_bytes, 1) / LANES, 1) * LANES;
+
+  out = fopen(fname.c_str(), "wb");
+  if (out == NULL)
+    throw_error("Unable to write " + fname);
+  TraceHeader header;
+  memcpy(header.magic, TRACE_MAGIC, sizeof(header.magic));
+  header.version = TRACE_VERSION;
+  header.num_bits = ops.size();
+  header.record_bytes = record_bytes;
+  header.num_players = bracket->num_players;
+  header.seed = seed;
+  fwrite(&header, sizeof(header), 1, out);
+  for (int b = 0; b < ops.size(); b++) {
+    std::string address = bracket->match_address(ops[b]);
+    fwrite(address.c_str(), 1, address.size() + 1, out);
+  }
+  for (int i = 0; i < bracket->num_players; i++) {
+    const std::string& name = bracket->players_in_bracket[i]->name;
+    fwrite(name.c_str(), 1, name.size() + 1, out);
+  }
+
+  for (int i = 0; i < num_threads * TRACE_BLOCKS_PER_THREAD; i++) {
+    blocks.emplace_back(new TraceBlock());
+    blocks[i]->num_sims = 0;
+    blocks[i]->records.resize((size_t) block_sims * record_bytes);
+    if (compress)
+      blocks[i]->packed.resize(compressBound(blocks[i]->records.size()));
+    empty.push(blocks[i].get());
+  }
+  current.assign(num_threads, NULL);
+}
+
+// Trace writer destructor
+TraceWriter::~TraceWriter() {
+  stop();
+  if (out != NULL)
+    fclose(out);
+}
+
+// Start the writer thread
+void TraceWriter::start() {
+  writer = std::thread(&TraceWriter::run, this);
+}
+
+// Hand off the blocks the threads are still filling, and wait for the writer
+// thread to write everything out. Only called while no thread is recording.
+void TraceWriter::stop() {
+  if (!writer.joinable())
+    return;
+  for (int t = 0; t < current.size(); t++)
+    if (current[t] != NULL)
+      hand_off(t);
+  stopping.store(true, std::memory_order_release);
+  writer.join();
+  if (fflush(out) != 0)
+    throw_error("Unable to write the trace");
+}
+
+// Return the block of thread t with room for num_sims simulations from sim
+// on, handing off the one it has if they do not follow on from it or fit
+TraceBlock* TraceWriter::block_for(int t, uint64_t sim, int num_sims) {
+  TraceBlock* block = current[t];
+  if (block != NULL && (block->num_sims + num_sims > block_sims ||
+                        sim != block->first_sim + block->num_sims)) {
+    hand_off(t);
+    block = NULL;
+  }
+  if (block == NULL) {
+    // Wait for the writer thread to free a block, if it has fallen behind
+    while ((block = empty.pop()) == NULL)
+      std::this_thread::yield();
+    block->first_sim = sim;
+    block->num_sims = 0;
+    current[t] = block;
+  }
+  return block;
+}
+
+// Record the results of simulation sim, run by thread t, given as
+// results[op]
+void TraceWriter::record(int t, uint64_t sim, const int* results) {
+  TraceBlock* block = block_for(t, sim, 1);
+  uint8_t* bytes = block->records.data() + (size_t) block->num_sims * record_bytes;
+  memset(bytes, 0, record_bytes);
+  for (int b = 0; b < ops.size(); b++)
+    bytes[b >> 3] |= (results[ops[b]] == 2) << (b & 7);
+  block->num_sims++;
+}
+
+// Record the results of the first num_sims lanes of a lockstep engine,
+// simulations first_sim on, run by thread t. Each byte of the records is
+// put together in every lane at once.
+void TraceWriter::record_lanes(int t, uint64_t first_sim, const int* results, int num_sims) {
+  TraceBlock* block = block_for(t, first_sim, num_sims);
+  uint8_t* records = block->records.data() + (size_t) block->num_sims * record_bytes;
+  uint8_t bytes[LANES];
+  for (int byte = 0; byte < record_bytes; byte++) {
+    for (int l = 0; l < LANES; l++)
+      bytes[l] = 0;
+    for (int b = byte * 8; b < (std::min)(byte * 8 + 8, (int) ops.size()); b++) {
+      const int* res = results + ops[b] * LANES;
+      #pragma omp simd
+      for (int l = 0; l < LANES; l++)
+        bytes[l] |= (res[l] == 2) << (b & 7);
+    }
+    for (int l = 0; l < num_sims; l++)
+      records[l * record_bytes + byte] = bytes[l];
+  }
+  block->num_sims += num_sims;
+}
+
+// Pass the block of thread t to the writer thread, compressing it first if
+// asked to (unless it does not shrink)
+void TraceWriter::hand_off(int t) {
+  TraceBlock* block = current[t];
+  current[t] = NULL;
+  block->flags = 0;
+  block->size = (size_t) block->num_sims * record_bytes;
+  if (compress) {
+    uLongf size = block->packed.size();
+    if (compress2(block->packed.data(), &size, block->records.data(), block->size,
+                  Z_BEST_SPEED) == Z_OK && size < block->size) {
+      block->flags = TRACE_COMPRESSED;
+      block->size = size;
+    }
+  }
+  // Always room, since there are only as many blocks as cells
+  full.push(block);
+}
+
+// Write a block out
+void TraceWriter::write_block(TraceBlock* block) {
+  TraceBlockHeader header;
+  header.first_sim = block->first_sim;
+  header.num_sims = block->num_sims;
+  header.flags = block->flags;
+  header.size = block->size;
+  const uint8_t* data = block->flags & TRACE_COMPRESSED ? block->packed.data() :
+                        block->records.data();
+  if (fwrite(&header, sizeof(header), 1, out) != 1 ||
+      fwrite(data, 1, header.size, out) != header.size)
+    throw_error("Unable to write the trace");
+}
+
+// Body of the writer thread: write out the blocks as they come, until stopped
+// with none left
+void TraceWriter::run() {
+  while (true) {
+    bool stopped = stopping.load(std::memory_order_acquire);
+    TraceBlock* block = full.pop();
+    if (block != NULL) {
+      write_block(block);
+      empty.push(block);
+    } else if (stopped) {
+      return;
+    } else {
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+  }
+}
+
+// Read a string up to a NUL
+static bool read_string(FILE* in, std::string& s) {
+  s.clear();
+  int c;
+  while ((c = fgetc(in)) > 0)
+    s += (char) c;
+  return c == 0;
+}
+
+// Print a trace written for the bracket as CSV, a line per simulation: its
+// index, the result of every set traced (0 if not played) and the placing of
+// every player, worked out by replaying the results through the bracket
+void read_trace(Bracket* bracket, std::string fname, FILE* output) {
+  FILE* in = fopen(fname.c_str(), "rb");
+  if (in == NULL)
+    throw_error("Unable to open " + fname);
+  TraceHeader header;
+  if (fread(&header, sizeof(header), 1, in) != 1 ||
+      memcmp(header.magic, TRACE_MAGIC, sizeof(header.magic)) != 0)
+    throw_error(fname + " is not a trace file");
+  if (header.version != TRACE_VERSION)
+    throw_error(fname + " is a trace file of version " + std::to_string(header.version) +
+                ", expected " + std::to_string(TRACE_VERSION));
+
+  std::vector<int> ops;
+  for (int k = 0; k < bracket->program.size(); k++)
+    if (bracket->program[k].result_fixed == 0)
+      ops.push_back(k);
+  std::string mismatch = fname + " was traced from a different bracket or results";
+  if (header.num_bits != ops.size() || header.record_bytes != (ops.size() + 7) / 8 ||
+      header.num_players != bracket->num_players)
+    throw_error(mismatch);
+  std::string s;
+  fprintf(output, "sim");
+  for (int b = 0; b < ops.size(); b++) {
+    if (!read_string(in, s) || s != bracket->match_address(ops[b]))
+      throw_error(mismatch);
+    fprintf(output, ",%s", s.c_str());
+  }
+  for (int i = 0; i < bracket->num_players; i++) {
+    if (!read_string(in, s) || s != bracket->players_in_bracket[i]->name)
+      throw_error(mismatch);
+    fprintf(output, ",%s", s.c_str());
+  }
+  fprintf(output, "\n");
+
+  std::vector<int> seats = bracket->seats;
+  std::vector<int> traced(ops.size()), placing(bracket->num_players);
+  std::vector<uint8_t> records, packed;
+  TraceBlockHeader block;
+  while (fread(&block, sizeof(block), 1, in) == 1) {
+    uLongf size = (uLongf) block.num_sims * header.record_bytes;
+    records.resize(size);
+    bool ok;
+    if (block.flags & TRACE_COMPRESSED) {
+      packed.resize(block.size);
+      ok = fread(packed.data(), 1, block.size, in) == block.size &&
+           uncompress(records.data(), &size, packed.data(), block.size) == Z_OK &&
+           size == records.size();
+    } else {
+      ok = block.size == size && fread(records.data(), 1, size, in) == size;
+    }
+    if (!ok)
+      throw_error(fname + " is truncated or corrupt");
+
+    for (int i = 0; i < block.num_sims; i++) {
+      const uint8_t* bytes = records.data() + (size_t) i * header.record_bytes;
+
+      // Replay the bracket program with these results, a set not played
+      // having a result of 0
+      int result = 0;
+      for (int k = 0, b = 0; k < bracket->program.size(); k++) {
+        const MatchOp& op = bracket->program[k];
+        int r = op.result_fixed;
+        if (r == 0)
+          r = (bytes[b >> 3] >> (b & 7) & 1) + 1;
+        if (op.conditional && result != 2)
+          r = 0;
+        if (op.result_fixed == 0)
+          traced[b++] = r;
+        if (r == 0)
+          continue;
+        result = r;
+        int id_1 = seats[op.seat], id_2 = seats[op.seat + 1];
+        seats[op.winner_to[result - 1]] = result == 1 ? id_1 : id_2;
+        seats[op.loser_to[result - 1]] = result == 1 ? id_2 : id_1;
+      }
+      for (std::vector<PlacingSeat>::iterator it = bracket->placing_seats.begin();
+           it != bracket->placing_seats.end(); it++)
+        placing[seats[it->seat]] = get_placing(it->placing);
+
+      fprintf(output, "%" PRIu64, block.first_sim + i);
+      for (int b = 0; b < ops.size(); b++)
+        fprintf(output, ",%d", traced[b]);
+      for (int p = 0; p < bracket->num_players; p++)
+        fprintf(output, ",%d", placing[p]);
+      fprintf(output, "\n");
+    }
+  }
+  fclose(in);
+}
@@ -0,0 +1,120 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <atomic>
+#include <memory>
+#include <thread>
+
+#include "Lockstep.hpp"
+
+// Target size of a block of simulations in a trace file, before compression
+#define TRACE_BLOCK_BYTES 65536
+
+// Blocks per simulation thread; these are all the memory a trace ever uses
+#define TRACE_BLOCKS_PER_THREAD 4
+
+// Trace file, written with --trace and read back with --read-trace: the
+// header, a NUL-terminated string per set traced naming it as for --serve
+// (e.g. "W3#5"), in bit order, one per player naming them, in the order of
+// their IDs in the bracket, then blocks up to the end of the file, each a
+// block header followed by the records of its simulations, compressed with
+// zlib if flagged.
+//
+// A record has one bit per set whose result is not fixed, in the order of the
+// bracket program: bit b is bit (b % 8) of byte (b / 8), set if player 2 won.
+// Grand finals set 2 has a bit of 0 when it is not played, which is when
+// player 1 won set 1. The players' placings follow from the results, and are
+// worked out by --read-trace. Simulations are numbered as for --seed, so any
+// one of them can be rerun; blocks are written as threads fill them, so they
+// are in no particular order.
+#define TRACE_MAGIC "BRTRACE"
+#define TRACE_VERSION 1
+#define TRACE_COMPRESSED 1  // Block flag
+
+struct TraceHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t num_bits;      // Sets traced
+  uint32_t record_bytes;  // Bytes per simulation
+  uint32_t num_players;
+  uint64_t seed;
+};
+
+struct TraceBlockHeader {
+  uint64_t first_sim;
+  uint32_t num_sims;
+  uint32_t flags;
+  uint64_t size;  // Bytes stored after the header
+};
+
+// A block of consecutive simulations
+struct TraceBlock {
+  uint64_t first_sim;
+  int num_sims;
+  uint32_t flags;
+  size_t size;                   // Bytes to write, once handed off
+  std::vector<uint8_t> records;  // [sim][byte]
+  std::vector<uint8_t> packed;   // The records compressed, if flagged
+};
+
+// Bounded lock-free queue of blocks, for any number of threads on either side.
+// Each cell carries a sequence number that says whether it is ready to be
+// pushed to or popped from on the current pass around the ring, so that a
+// thread claims a cell with a single compare-and-swap of the head or tail.
+class BlockQueue {
+ public:
+  explicit BlockQueue(size_t);
+  bool push(TraceBlock*);
+  TraceBlock* pop();
+
+ private:
+  struct Cell {
+    std::atomic<size_t> sequence;
+    TraceBlock* block;
+  };
+
+  std::unique_ptr<Cell[]> cells;
+  size_t mask;
+  alignas(CACHE_LINE) std::atomic<size_t> tail;  // Next cell to push to
+  alignas(CACHE_LINE) std::atomic<size_t> head;  // Next cell to pop from
+};
+
+// Trace of every simulation of a run. Each thread fills a block of its own
+// with the records of the simulations it runs; when the block is full, or the
+// next simulation does not follow on from it, the thread compresses it (if
+// asked to) and pushes it onto a queue to a writer thread, taking an empty
+// block from a second queue. The writer thread writes each block out and
+// returns it to the empty queue. A fixed number of blocks is shared between
+// them, so a thread only ever waits if the writer falls that far behind.
+class TraceWriter {
+ public:
+  TraceWriter(Bracket*, int, uint64_t, std::string, bool);
+  ~TraceWriter();
+  void start();
+  void stop();
+  void record(int, uint64_t, const int*);
+  void record_lanes(int, uint64_t, const int*, int);
+
+ private:
+  FILE* out;
+  bool compress;
+  std::vector<int> ops;  // Set of the program traced by each bit
+  int record_bytes;
+  int block_sims;
+
+  std::vector<std::unique_ptr<TraceBlock>> blocks;
+  std::vector<TraceBlock*> current;  // Block being filled by each thread, or NULL
+  BlockQueue full, empty;
+
+  std::thread writer;
+  std::atomic<bool> stopping;
+
+  TraceBlock* block_for(int, uint64_t, int);
+  void hand_off(int);
+  void write_block(TraceBlock*);
+  void run();
+};
+
+void read_trace(Bracket*, std::string, FILE* = stdout);
+
+#endif
@@ -0,0 +1,221 @@
+#include <chrono>
+
+#include "Bracket.hpp"
+#include "Lockstep.hpp"
+#include "Synthetic.hpp"
+
+// Benchmark suite, run by `make bench`: microbenchmarks of the pieces of a
+// simulation, then end-to-end runs over generated brackets of 32 to 2048
+// entrants with updated ratings (with the reference and fast Glicko kernels)
+// and static ratings, both engines and a sweep over the number of threads.
+// Results are printed and written as JSON to the file given
+// (bench_results.json by default), tagged with the commit given, so that runs
+// from two commits can be compared.
+
+#define MIN_SECONDS 0.2   // each microbenchmark runs for at least this long
+#define E2E_SETS 4000000  // sets played by each end-to-end run
+
+volatile float sink;  // Keeps the results of the microbenchmarks alive
+
+// Call a benchmark body with 0, 1, 2, ... until it has run for MIN_SECONDS,
+// doubling the calls each time, and return the nanoseconds per operation
+template <typename F>
+double time_ns(F body, double ops_per_call) {
+  for (int64_t calls = 1;; calls *= 2) {
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    for (int64_t c = 0; c < calls; c++)
+      body(c);
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() -
+                                                   start).count();
+    if (seconds >= MIN_SECONDS)
+      return seconds * 1.e9 / (calls * ops_per_call);
+  }
+}
+
+struct MicroResult {
+  std::string name;
+  std::string unit;
+  double ns;
+};
+
+struct RunResult {
+  int entrants;
+  bool update_ratings;
+  bool fast_glicko;
+  std::string engine;
+  int threads;
+  int64_t sims;
+  double sims_per_second;
+};
+
+std::vector<MicroResult> micro_benchmarks() {
+  std::vector<MicroResult> results;
+
+  results.push_back({"RandomStream::uniform", "draw", time_ns([](int64_t c) {
+    RandomStream stream(1, c);
+    float x = 0.;
+    for (int k = 0; k < 1024; k++)
+      x += stream.uniform(k);
+    sink = x;
+  }, 1024)});
+
+  std::vector<float> ratings(1024), RDs(1024);
+  for (int k = 0; k < 1024; k++) {
+    ratings[k] = 1600. + 800. * k / 1024;
+    RDs[k] = 50. + k % 200;
+  }
+  results.push_back({"win_probability", "call", time_ns([&](int64_t c) {
+    float x = 0.;
+    for (int k = 0; k < 1024; k++)
+      x += win_probability(ratings[k], RDs[k], ratings[(k + c) & 1023], RDs[(k + c) & 1023]);
+    sink = x;
+  }, 1024)});
+  const GlickoConstants constants(pi, q, qs);
+  results.push_back({"fast_win_probability", "call", time_ns([&](int64_t c) {
+    float x = 0.;
+    for (int k = 0; k < 1024; k++)
+      x += fast_win_probability(ratings[k], RDs[k], ratings[(k + c) & 1023], RDs[(k + c) & 1023],
+                                constants);
+    sink = x;
+  }, 1024)});
+
+  // Lookups in a database of 100,000 players
+  PlayerDatabase library;
+  std::vector<std::string> names;
+  for (int p = 0; p < 100000; p++)
+    library.add("Player " + std::to_string(p), 1500. + p % 1000, 100.);
+  for (int k = 0; k < 1024; k++)
+    names.push_back("Player " + std::to_string(k * 97 % 100000));
+  results.push_back({"PlayerDatabase::find", "lookup", time_ns([&](int64_t) {
+    int x = 0;
+    for (int k = 0; k < 1024; k++)
+      x += library.find(names[k]);
+    sink = x;
+  }, 1024)});
+
+  // Building a bracket along with its player library
+  results.push_back({"Bracket setup (512 entrants)", "bracket", time_ns([](int64_t) {
+    PlayerDatabase database;
+    delete generate_bracket(512, 512, database);
+  }, 1)});
+
+  PlayerDatabase database;
+  Bracket* bracket = generate_bracket(128, 128, database);
+  LockstepEngine* engine = new LockstepEngine(bracket);
+  results.push_back({"Bracket::play (128 entrants)", "set", time_ns([&](int64_t c) {
+    bracket->play(RandomStream(1, c));
+  }, bracket->program.size())});
+  results.push_back({"Bracket::simulate (128 entrants)", "simulation", time_ns([&](int64_t c) {
+    bracket->simulate(RandomStream(1, c));
+  }, 1)});
+  results.push_back({"LockstepEngine::simulate (128 entrants)", "simulation",
+  time_ns([&](int64_t c) {
+    engine->simulate(1, (uint64_t) c * LANES, LANES);
+  }, LANES)});
+  delete engine;
+  delete bracket;
+
+  return results;
+}
+
+// Time n simulations of the given brackets (one per thread) on num_threads threads
+double sims_per_second(std::vector<Bracket*>& brackets, std::vector<LockstepEngine*>& engines,
+                       int64_t n, int num_threads) {
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  if (!engines.empty()) {
+    #pragma omp parallel for num_threads(num_threads) schedule(guided)
+    for (int64_t b = 0; b < n / LANES; b++)
+      engines[THREAD_NUM]->simulate(1, (uint64_t) b * LANES, LANES);
+  } else {
+    #pragma omp parallel for num_threads(num_threads) schedule(guided)
+    for (int64_t i = 0; i < n; i++)
+      brackets[THREAD_NUM]->simulate(RandomStream(1, i));
+  }
+  return n / std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+std::vector<RunResult> end_to_end_benchmarks() {
+  int max_threads = 1;
+#ifdef _OPENMP
+  max_threads = omp_get_max_threads();
+#endif
+  std::vector<int> thread_counts;
+  for (int t = 1; t < max_threads; t *= 2)
+    thread_counts.push_back(t);
+  thread_counts.push_back(max_threads);
+
+  std::vector<RunResult> results;
+  const char* modes[3] = {"updated", "fast", "static"};
+  for (int entrants : {32, 128, 512, 2048})
+    for (int mode = 0; mode < 3; mode++) {
+      update_ratings = mode < 2;
+      fast_glicko = mode == 1;
+      PlayerDatabase database;
+      std::vector<Bracket*> brackets(max_threads);
+      std::vector<LockstepEngine*> engines(max_threads), none;
+      for (int t = 0; t < max_threads; t++) {
+        brackets[t] = generate_bracket(entrants, entrants, database);
+        engines[t] = new LockstepEngine(brackets[t]);
+      }
+      int64_t n = (std::max)((int64_t) E2E_SETS / (int64_t) brackets[0]->program.size() /
+                             LANES * LANES, (int64_t) LANES);
+
+      for (std::string engine : {"scalar", "simd"})
+        for (int threads : thread_counts) {
+          RunResult result = {entrants, update_ratings, fast_glicko, engine, threads, n,
+                              sims_per_second(brackets, engine == "simd" ? engines : none, n,
+                                              threads)};
+          results.push_back(result);
+          printf("  %-10d%-10s%-8s%9d%14.0f\n", entrants, modes[mode], engine.c_str(), threads,
+                 result.sims_per_second);
+          fflush(stdout);
+        }
+
+      for (int t = 0; t < max_threads; t++) {
+        delete engines[t];
+        delete brackets[t];
+      }
+    }
+  update_ratings = true;
+  fast_glicko = false;
+  return results;
+}
+
+int main(int argc, char** argv) {
+  std::string fname = argc > 1 ? argv[1] : "bench_results.json";
+  std::string commit = argc > 2 ? argv[2] : "";
+
+  printf("  %-42s%12s\n", "Microbenchmark", "ns");
+  printf("  %s\n", std::string(54, '-').c_str());
+  std::vector<MicroResult> micro = micro_benchmarks();
+  for (int i = 0; i < micro.size(); i++)
+    printf("  %-42s%12.2f  per %s\n", micro[i].name.c_str(), micro[i].ns, micro[i].unit.c_str());
+  printf("\n");
+
+  printf("  %-10s%-10s%-8s%9s%14s\n", "Entrants", "Ratings", "Engine", "Threads", "Sims/s");
+  printf("  %s\n", std::string(51, '-').c_str());
+  std::vector<RunResult> runs = end_to_end_benchmarks();
+  printf("\n");
+
+  FILE* out = fopen(fname.c_str(), "w");
+  if (out == NULL)
+    throw_error("Unable to write " + fname);
+  fprintf(out, "{\n  \"commit\": \"%s\",\n  \"micro\": [\n", commit.c_str());
+  for (int i = 0; i < micro.size(); i++)
+    fprintf(out, "    {\"name\": \"%s\", \"unit\": \"%s\", \"ns\": %.3f}%s\n",
+            micro[i].name.c_str(), micro[i].unit.c_str(), micro[i].ns,
+            i + 1 < micro.size() ? "," : "");
+  fprintf(out, "  ],\n  \"end_to_end\": [\n");
+  for (int i = 0; i < runs.size(); i++)
+    fprintf(out, "    {\"entrants\": %d, \"update_ratings\": %s, \"fast_glicko\": %s, "
+            "\"engine\": \"%s\", \"threads\": %d, \"sims\": %" PRId64 ", "
+            "\"sims_per_second\": %.1f}%s\n",
+            runs[i].entrants, runs[i].update_ratings ? "true" : "false",
+            runs[i].fast_glicko ? "true" : "false", runs[i].engine.c_str(),
+            runs[i].threads, runs[i].sims, runs[i].sims_per_second,
+            i + 1 < runs.size() ? "," : "");
+  fprintf(out, "  ]\n}\n");
+  fclose(out);
+  printf("Results written to %s\n", fname.c_str());
+  return 0;
+}
@@ -0,0 +1,12 @@
+#include "Bracket.hpp"
+
+// Convert player_data.txt in the current directory to the binary ratings file
+// player_data.bin, which the predictor maps into memory instead of parsing
+// the text. Run it again whenever player_data.txt changes.
+int main() {
+  PlayerDatabase database;
+  load_player_data(database, false);
+  database.save(RATINGS_FILE);
+  std::cout << "Wrote " << database.size() << " players to " << RATINGS_FILE << std::endl;
+  return 0;
+}
@@ -0,0 +1,67 @@
+#include "Bracket.hpp"
+#include "Checkpoint.hpp"
+
+// Combine the result files (final checkpoints) of independent runs, e.g. on
+// several machines, into one table:
+//   merge_results run1.ckpt run2.ckpt ...
+// Run it in the bracket directory the runs were made from; every file must
+// match the bracket, results and player data there, and have the same
+// ratings mode. The runs must have different seeds, as runs with the same
+// seed simulate the same brackets. Unfinished checkpoints can be merged too;
+// each counts the simulations it has run so far.
+int main(int argc, char** argv) {
+  if (argc < 2)
+    throw_error("Usage: merge_results FILE...");
+
+  int num_W, num_L;
+  std::vector<std::vector<int>> wl_map, res_fixed_W, res_fixed_L, res_fixed_G;
+  load_bracket_params(num_W, num_L, wl_map, res_fixed_W, res_fixed_L, res_fixed_G);
+  std::vector<std::string> players_W, players_L;
+  load_initial_players(players_W, players_L);
+  PlayerDatabase database;
+  load_player_data(database);
+  Bracket* bracket = new Bracket(num_W, num_L);
+  bracket->set_player_database(&database);
+  bracket->set_structure(wl_map);
+  bracket->set_initial_players(players_W, players_L, 0);
+  bracket->set_res_fixed(res_fixed_W, res_fixed_L, res_fixed_G);
+
+  int num_placings = bracket->num_rounds_P;
+  std::vector<int64_t> counts(bracket->num_players * num_placings, 0);
+  std::vector<uint64_t> seeds;
+  uint32_t ratings_mode = 0;
+  int64_t n = 0;
+  for (int a = 1; a < argc; a++) {
+    Checkpoint checkpoint = load_checkpoint(argv[a]);
+    const CheckpointHeader& header = checkpoint.header;
+    check_inputs(checkpoint, bracket, argv[a]);
+    if (a == 1)
+      ratings_mode = header.flags & CHECKPOINT_STATIC;
+    else if ((header.flags & CHECKPOINT_STATIC) != ratings_mode)
+      throw_error(std::string(argv[a]) + " was made with " +
+                  (ratings_mode ? "updated" : "static") + " ratings, unlike " + argv[1]);
+    if (std::find(seeds.begin(), seeds.end(), header.seed) != seeds.end())
+      throw_error(std::string(argv[a]) + " was made with seed " + std::to_string(header.seed) +
+                  ", as was an earlier file, so their simulations are the same");
+    seeds.push_back(header.seed);
+    if (header.num_run < header.n)
+      throw_warning(std::string(argv[a]) + " is unfinished, with " +
+                    std::to_string(header.num_run) + " of " + std::to_string(header.n) +
+                    " simulations");
+    for (int i = 0; i < counts.size(); i++)
+      counts[i] += checkpoint.counts[i];
+    n += header.num_run;
+  }
+
+  for (int i = 0; i < bracket->num_players; i++) {
+    Player* player = bracket->players_in_bracket[i];
+    for (int p = 0; p < num_placings; p++)
+      player->placings[p] = counts[i * num_placings + p];
+    player->calc_avg_points();
+  }
+  print_results(bracket->players_in_bracket, num_placings);
+  std::cout << "Number of simulations merged: " << n << " from " << argc - 1 << " files"
+            << std::endl;
+  delete bracket;
+  return 0;
+}
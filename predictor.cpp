@@ -1,11 +1,44 @@
 #include <chrono>
 
-#ifdef __linux__
-#include <sys/ioctl.h>
-#include <unistd.h>
-#endif
-
 #include "Bracket.hpp"
+#include "Checkpoint.hpp"
+#include "Circuit.hpp"
+#include "Exact.hpp"
+#include "Lockstep.hpp"
+#include "Meetings.hpp"
+#include "Pool.hpp"
+#include "Profile.hpp"
+#include "Scenario.hpp"
+#include "Seeding.hpp"
+#include "Server.hpp"
+#include "Telemetry.hpp"
+#include "Trace.hpp"
+
+// Options for running until a target precision is reached
+#define MAX_ADAPTIVE_SIMS 100000000  // default limit on the number of simulations
+#define FIRST_BATCH 20000            // simulations run before the first check
+#define CONFIDENCE_Z 1.96            // standard deviations for 95% intervals
+
+// Options for optimizing the seeding
+#define SEEDING_SIMS 2000  // default simulations per candidate seeding
+#define TOP_SEEDS 8        // default number of top seeds whose points are maximized
+
+// Match a command line option given as "--name=value" or "--name value",
+// advancing the argument index past a separate value
+bool get_option(int argc, char** argv, int& a, std::string name, std::string& value) {
+  std::string arg(argv[a]);
+  if (arg.compare(0, name.size() + 1, name + "=") == 0) {
+    value = arg.substr(name.size() + 1);
+    return true;
+  }
+  if (arg == name) {
+    if (a + 1 >= argc)
+      throw_error("Option " + name + " requires a value");
+    value = argv[++a];
+    return true;
+  }
+  return false;
+}
 
 int main(int argc, char** argv) {
   // OpenMP setup
@@ -18,21 +51,268 @@ int main(int argc, char** argv) {
   num_threads = 1;
 #endif
 
-  // Number of simulations
-  int n = 100000;
-  if (argc > 1) {
-    try {
-      n = std::stoi(argv[1]);
-      if (n <= 0)
-        throw 1;
-    } catch (...) {
-      std::string n_str(argv[1]);
-      throw_error("Number of simulations = " + n_str +
-                  ", must be a positive integer");
+  // Command line arguments
+  int64_t n = 100000;
+  bool n_given = false;
+  float precision = 0.;
+  uint64_t seed;
+  bool seed_given = false;
+  bool lockstep = false;
+  bool exact = false;
+  bool serve = false;
+  std::string socket_path;
+  std::string scenario_file;
+  std::string strata_sets;
+  std::string target_name;
+  bool count_meetings = false;
+  std::string meetings_file;
+  float tilt = 0.5;
+  int seeding_iterations = 0;
+  int num_top_seeds = TOP_SEEDS;
+  std::string seeding_file;
+  std::string circuit_file;
+  bool use_pool = false;
+  bool pin = false;
+#ifdef PROGRESS_BAR
+  bool progress = true;
+#else
+  bool progress = false;
+#endif
+  std::string telemetry_file;
+  std::string trace_file;
+  bool compress_trace = false;
+  std::string read_trace_file;
+  std::string checkpoint_file;
+  float checkpoint_interval = CHECKPOINT_INTERVAL;
+  std::string resume_file;
+  bool profile = false;
+  for (int a = 1; a < argc; a++) {
+    std::string arg(argv[a]);
+    std::string value;
+    if (get_option(argc, argv, a, "--seed", value)) {
+      try {
+        size_t pos;
+        seed = std::stoull(value, &pos);
+        if (pos != value.size() || value[0] == '-')
+          throw 1;
+      } catch (...) {
+        throw_error("Seed = " + value + ", must be a non-negative integer");
+      }
+      seed_given = true;
+    } else if (get_option(argc, argv, a, "--engine", value)) {
+      if (value == "simd")
+        lockstep = true;
+      else if (value != "scalar")
+        throw_error("Engine = " + value + ", must be either scalar or simd");
+    } else if (get_option(argc, argv, a, "--scheduler", value)) {
+      if (value == "pool")
+        use_pool = true;
+      else if (value != "openmp")
+        throw_error("Scheduler = " + value + ", must be either openmp or pool");
+    } else if (get_option(argc, argv, a, "--precision", value)) {
+      try {
+        size_t pos;
+        precision = std::stof(value, &pos);
+        if (pos != value.size() || !(precision > 0.))
+          throw 1;
+      } catch (...) {
+        throw_error("Precision = " + value + ", must be a positive number");
+      }
+    } else if (get_option(argc, argv, a, "--socket", value)) {
+      serve = true;
+      socket_path = value;
+    } else if (get_option(argc, argv, a, "--scenarios", value)) {
+      scenario_file = value;
+    } else if (get_option(argc, argv, a, "--condition", value)) {
+      strata_sets = value;
+    } else if (get_option(argc, argv, a, "--target", value)) {
+      target_name = value;
+    } else if (get_option(argc, argv, a, "--tilt", value)) {
+      try {
+        size_t pos;
+        tilt = std::stof(value, &pos);
+        if (pos != value.size() || !(tilt > 0. && tilt < 1.))
+          throw 1;
+      } catch (...) {
+        throw_error("Tilt = " + value + ", must be a probability between 0 and 1");
+      }
+    } else if (get_option(argc, argv, a, "--optimize-seeding", value)) {
+      try {
+        size_t pos;
+        seeding_iterations = std::stoi(value, &pos);
+        if (pos != value.size() || seeding_iterations <= 0)
+          throw 1;
+      } catch (...) {
+        throw_error("Iterations = " + value + ", must be a positive integer");
+      }
+    } else if (get_option(argc, argv, a, "--top-seeds", value)) {
+      try {
+        size_t pos;
+        num_top_seeds = std::stoi(value, &pos);
+        if (pos != value.size() || num_top_seeds <= 0)
+          throw 1;
+      } catch (...) {
+        throw_error("Top seeds = " + value + ", must be a positive integer");
+      }
+    } else if (get_option(argc, argv, a, "--best-seeding", value)) {
+      seeding_file = value;
+    } else if (get_option(argc, argv, a, "--circuit", value)) {
+      circuit_file = value;
+    } else if (arg == "--meetings") {
+      count_meetings = true;
+    } else if (get_option(argc, argv, a, "--meetings", value)) {
+      count_meetings = true;
+      meetings_file = value;
+    } else if (arg == "--serve") {
+      serve = true;
+    } else if (get_option(argc, argv, a, "--telemetry", value)) {
+      telemetry_file = value;
+    } else if (get_option(argc, argv, a, "--trace", value)) {
+      trace_file = value;
+    } else if (arg == "--compress-trace") {
+      compress_trace = true;
+    } else if (get_option(argc, argv, a, "--read-trace", value)) {
+      read_trace_file = value;
+    } else if (get_option(argc, argv, a, "--checkpoint", value)) {
+      checkpoint_file = value;
+    } else if (get_option(argc, argv, a, "--checkpoint-interval", value)) {
+      try {
+        size_t pos;
+        checkpoint_interval = std::stof(value, &pos);
+        if (pos != value.size() || !(checkpoint_interval > 0.))
+          throw 1;
+      } catch (...) {
+        throw_error("Checkpoint interval = " + value + ", must be a positive number of seconds");
+      }
+    } else if (get_option(argc, argv, a, "--resume", value)) {
+      resume_file = value;
+    } else if (arg == "--progress") {
+      progress = true;
+    } else if (arg == "--profile") {
+#ifdef PROFILE
+      profile = true;
+      profiler.enable(num_threads);
+#else
+      throw_error("--profile needs a build with profiling compiled in; use make profile");
+#endif
+    } else if (arg == "--pin") {
+      pin = true;
+    } else if (arg == "--fast-glicko") {
+      fast_glicko = true;
+    } else if (arg == "--static-ratings") {
+      update_ratings = false;
+    } else if (arg == "--exact") {
+      exact = true;
+      update_ratings = false;
+    } else {
+      // Number of simulations
+      try {
+        n = std::stoll(arg);
+        if (n <= 0)
+          throw 1;
+      } catch (...) {
+        throw_error("Number of simulations = " + arg +
+                    ", must be a positive integer");
+      }
+      n_given = true;
     }
   }
 
+  if (serve && (exact || precision > 0.))
+    throw_error("--serve cannot be combined with --exact or --precision");
+  if (precision > 0. && exact)
+    throw_error("--precision cannot be combined with --exact");
+  if (!scenario_file.empty() && (exact || serve || precision > 0.))
+    throw_error("--scenarios cannot be combined with --exact, --serve or --precision");
+  if (!strata_sets.empty() && (exact || serve))
+    throw_error("--condition cannot be combined with --exact or --serve");
+  if (!target_name.empty() && (exact || serve || lockstep || precision > 0. ||
+                               !scenario_file.empty() || !strata_sets.empty()))
+    throw_error("--target only works with the scalar engine, and cannot be combined with "
+                "--exact, --serve, --precision, --scenarios or --condition");
+  if (seeding_iterations > 0 && (exact || serve || precision > 0. || !scenario_file.empty() ||
+                                 !strata_sets.empty() || !target_name.empty()))
+    throw_error("--optimize-seeding cannot be combined with --exact, --serve, --precision, "
+                "--scenarios, --condition or --target");
+  if (count_meetings && (exact || serve || seeding_iterations > 0 || !scenario_file.empty() ||
+                         !target_name.empty()))
+    throw_error("--meetings cannot be combined with --exact, --serve, --optimize-seeding, "
+                "--scenarios or --target");
+
+  if (!circuit_file.empty() && (exact || serve || lockstep || !update_ratings ||
+                                precision > 0. || !scenario_file.empty() ||
+                                !strata_sets.empty() || !target_name.empty() ||
+                                count_meetings || seeding_iterations > 0))
+    throw_error("--circuit only works with the scalar engine and updated ratings, and cannot "
+                "be combined with other options");
+
+  if (use_pool && (serve || seeding_iterations > 0 || !circuit_file.empty()))
+    throw_error("--scheduler=pool cannot be combined with --serve, --optimize-seeding or "
+                "--circuit");
+  if (!telemetry_file.empty() && (exact || serve || seeding_iterations > 0 ||
+                                  !circuit_file.empty()))
+    throw_error("--telemetry cannot be combined with --exact, --serve, --optimize-seeding or "
+                "--circuit");
+  if (profile && (exact || serve || seeding_iterations > 0 || !circuit_file.empty()))
+    throw_error("--profile cannot be combined with --exact, --serve, --optimize-seeding or "
+                "--circuit");
+  if (!trace_file.empty() && (exact || serve || seeding_iterations > 0 ||
+                              !circuit_file.empty() || !scenario_file.empty() ||
+                              !target_name.empty()))
+    throw_error("--trace cannot be combined with --exact, --serve, --optimize-seeding, "
+                "--circuit, --scenarios or --target");
+  if (compress_trace && trace_file.empty())
+    throw_error("--compress-trace needs a trace file, given with --trace");
+  if (!trace_file.empty() && !resume_file.empty())
+    throw_error("--trace cannot be combined with --resume, as the trace of the simulations "
+                "run before the checkpoint would be lost");
+  if (checkpoint_file.empty())
+    checkpoint_file = resume_file;
+  if (!checkpoint_file.empty() && (exact || serve || precision > 0. || seeding_iterations > 0 ||
+                                   !circuit_file.empty() || !scenario_file.empty() ||
+                                   !strata_sets.empty() || !target_name.empty() ||
+                                   count_meetings))
+    throw_error("--checkpoint and --resume cannot be combined with --exact, --serve, "
+                "--precision, --optimize-seeding, --circuit, --scenarios, --condition, "
+                "--target or --meetings");
+  if (pin && !use_pool)
+    throw_error("--pin only works with --scheduler=pool; with OpenMP, set OMP_PROC_BIND instead");
+
+  // With a target precision, n is the most simulations that will be run
+  bool adaptive = precision > 0.;
+  if (adaptive && !n_given)
+    n = MAX_ADAPTIVE_SIMS;
+  if (seeding_iterations > 0 && !n_given)
+    n = SEEDING_SIMS;
+  if (!seed_given) {
+    std::random_device rdv;
+    seed = ((uint64_t) rdv() << 32) | rdv();
+  }
+
+  // Simulate a season of events n times, each event starting from the
+  // ratings the previous one ended with
+  if (!circuit_file.empty()) {
+    Circuit circuit(circuit_file, num_threads);
+    std::chrono::high_resolution_clock::time_point start, end;
+    start = std::chrono::high_resolution_clock::now();
+    #pragma omp parallel for schedule(guided)
+    for (int64_t i = 0; i < n; i++)
+      circuit.simulate(THREAD_NUM, seed, i);
+    end = std::chrono::high_resolution_clock::now();
+    circuit.print(n);
+
+    float duration = std::chrono::
+                     duration_cast<std::chrono::microseconds>(end - start).count() * 1.e-6;
+    std::cout << "Number of seasons run: " << n << " (" << circuit.events.size()
+              << " events, " << circuit.num_players() << " players)" << std::endl;
+    std::cout << "Seed: " << seed << std::endl;
+    std::cout << "Time taken: " << duration << " seconds; "
+              << n / duration << " per second" << std::endl;
+    return 0;
+  }
+
   // Load bracket parameters from file
+  PROFILE_PHASE_BEGIN(PHASE_PARSING);
   int num_W, num_L;
   std::vector<std::vector<int>> wl_map, res_fixed_W, res_fixed_L, res_fixed_G;
   load_bracket_params(num_W, num_L, wl_map, res_fixed_W, res_fixed_L, res_fixed_G);
@@ -42,122 +322,355 @@ int main(int argc, char** argv) {
   load_initial_players(players_W, players_L);
 
   // Load player data from file
-  std::vector<playerLibrary> player_libraries(num_threads);
-  player_libraries[0] = load_player_data();
-  for (int t = 1; t < num_threads; t++)
-    player_libraries[t] = copy_player_library(player_libraries[0]);
+  PlayerDatabase database;
+  load_player_data(database);
+  PROFILE_PHASE_END(PHASE_PARSING);
+  PROFILE_PHASE_BEGIN(PHASE_SETUP);
+
+  // Run a setup step for every thread. With the worker pool, each worker runs
+  // its own, so that the memory it allocates is first touched by that worker.
+  WorkerPool* pool = use_pool ? new WorkerPool(num_threads, pin) : NULL;
+  auto per_thread = [&](const std::function<void(int)>& step) {
+    if (pool != NULL)
+      pool->run(step);
+    else
+      for (int t = 0; t < num_threads; t++)
+        step(t);
+  };
 
   // Setup the bracket
   std::vector<Bracket*> brackets(num_threads);
-  for (int t = 0; t < num_threads; t++) {
+  per_thread([&](int t) {
     brackets[t] = new Bracket(num_W, num_L);
-    brackets[t]->set_player_library(player_libraries[t]);
+    brackets[t]->set_player_database(&database);
     brackets[t]->set_structure(wl_map);
     brackets[t]->set_initial_players(players_W, players_L, t);
     brackets[t]->set_res_fixed(res_fixed_W, res_fixed_L, res_fixed_G);
+  });
+
+  // Carry on from the counts and seed of a checkpoint, which must be of a run
+  // with the same inputs and options
+  uint32_t checkpoint_flags = (lockstep ? CHECKPOINT_SIMD : 0) |
+                              (update_ratings ? 0 : CHECKPOINT_STATIC) |
+                              (fast_glicko ? CHECKPOINT_FAST_GLICKO : 0);
+  int64_t num_resumed = 0;
+  if (!resume_file.empty()) {
+    Checkpoint checkpoint = load_checkpoint(resume_file);
+    const CheckpointHeader& header = checkpoint.header;
+    check_inputs(checkpoint, brackets[0], resume_file);
+    if (header.flags != checkpoint_flags)
+      throw_error(resume_file + " was made with a different --engine, --static-ratings or "
+                  "--fast-glicko");
+    if (seed_given && seed != header.seed)
+      throw_error(resume_file + " was made with seed " + std::to_string(header.seed));
+    seed = header.seed;
+    if (!n_given)
+      n = header.n;
+    else if (n < header.num_run)
+      throw_error(resume_file + " already has " + std::to_string(header.num_run) +
+                  " simulations, more than the " + std::to_string(n) + " asked for");
+    num_resumed = header.num_run;
+    for (int i = 0; i < brackets[0]->num_players; i++) {
+      Player* player = brackets[0]->players_in_bracket[i];
+      for (int p = 0; p < header.num_placings; p++)
+        player->placings[p] = checkpoint.counts[i * header.num_placings + p];
+      player->calc_avg_points();
+    }
   }
 
-  // Progress bar setup
-#ifdef PROGRESS_BAR
-  int j = 0;
-  int pbarWidth, pos_prev, pct_prev;
-  {
-#if defined _WIN32
-    CONSOLE_SCREEN_BUFFER_INFO csbi;
-    GetConsoleScreenBufferInfo(GetStdHandle(STD_OUTPUT_HANDLE), &csbi);
-    int columns = csbi.srWindow.Right - csbi.srWindow.Left + 1;
-    pbarWidth = columns - 9;
-#elif defined __linux__
-    struct winsize console_size;
-    ioctl(STDOUT_FILENO, TIOCGWINSZ, &console_size);
-    pbarWidth = console_size.ws_col - 9;
-#else
-    pbarWidth = 100;
-#endif
+  // Print a trace written by an earlier run as CSV, rather than simulating
+  if (!read_trace_file.empty()) {
+    read_trace(brackets[0], read_trace_file);
+    return 0;
   }
-#endif
 
-  std::vector<int> num_sims_per_thread(num_threads);
+  // Compute the placing probabilities exactly rather than simulating, and
+  // report them as expected counts out of n
+  if (exact) {
+    std::chrono::high_resolution_clock::time_point start, end;
+    start = std::chrono::high_resolution_clock::now();
+    ExactSolver solver(brackets[0]);
+    solver.solve();
+    end = std::chrono::high_resolution_clock::now();
+
+    std::vector<Player*> players_in_bracket = brackets[0]->players_in_bracket;
+    for (int i = 0; i < players_in_bracket.size(); i++) {
+      Player* player = players_in_bracket[i];
+      float p = 100.;
+      player->avg_points = 0.;
+      for (int j = 0; j < brackets[0]->num_rounds_P; j++) {
+        player->placings[j] = llround(solver.placings[i][j] * n);
+        player->avg_points += solver.placings[i][j] * p;
+        p *= 0.75;
+      }
+    }
+    print_results(players_in_bracket, brackets[0]->num_rounds_P);
+
+    long dur_us = std::chrono::
+                  duration_cast<std::chrono::microseconds>(end - start).count();
+    std::cout << "Expected counts out of " << n << " simulations, computed exactly ("
+              << solver.max_states << " states at most)" << std::endl;
+    std::cout << "Time taken: " << dur_us * 1.e-6 << " seconds" << std::endl;
+    return 0;
+  }
+
+  std::vector<LockstepEngine*> engines(num_threads);
+  if (lockstep)
+    per_thread([&](int t) {
+      engines[t] = new LockstepEngine(brackets[t]);
+    });
+
+  // Keep the brackets in memory and re-simulate as results come in
+  if (serve) {
+    OddsServer server(brackets, engines, lockstep, n, seed);
+    if (socket_path.empty())
+      server.serve(stdin, stdout);
+    else
+      server.serve_socket(socket_path);
+    return 0;
+  }
+
+  // Search for the seeding that gives the top seeds the most points, each
+  // candidate being simulated n times
+  if (seeding_iterations > 0) {
+    SeedingOptimizer optimizer(brackets, engines, n, seed, num_top_seeds);
+    optimizer.optimize(seeding_iterations);
+    optimizer.print(seeding_file);
+    return 0;
+  }
+
+  // Sets to stratify the placings by
+  if (!strata_sets.empty()) {
+    std::vector<int> ops = brackets[0]->parse_sets(strata_sets);
+    if (ops.empty())
+      throw_error("Condition = " + strata_sets + ", must be a list of sets such as "
+                  "W3#5,L4#0, rounds such as W3, or pending");
+    per_thread([&](int t) {
+      brackets[t]->set_strata(ops);
+    });
+  }
+
+  // Player to importance-sample toward
+  if (!target_name.empty()) {
+    int id = 0;
+    while (id < brackets[0]->players_in_bracket.size() &&
+           brackets[0]->players_in_bracket[id]->name != target_name)
+      id++;
+    if (id == brackets[0]->players_in_bracket.size())
+      throw_error("Target = " + target_name + ", must be a player in the bracket");
+    per_thread([&](int t) {
+      brackets[t]->set_target(id, tilt);
+    });
+  }
+
+  // Head-to-head meeting counts, per thread
+  std::vector<MeetingMatrix*> meetings;
+  if (count_meetings) {
+    meetings.resize(num_threads);
+    per_thread([&](int t) {
+      meetings[t] = new MeetingMatrix(brackets[t]);
+    });
+  }
+
+  // What-if scenarios to simulate alongside the bracket
+  ScenarioBatch* scenario_batch = NULL;
+  if (!scenario_file.empty()) {
+    scenario_batch = new ScenarioBatch(brackets, engines);
+    scenario_batch->load(scenario_file);
+  }
+
+
+  Telemetry telemetry(num_threads, n - num_resumed, progress, telemetry_file);
+  TraceWriter* trace = NULL;
+  if (!trace_file.empty())
+    trace = new TraceWriter(brackets[0], num_threads, seed, trace_file, compress_trace);
+  PROFILE_PHASE_END(PHASE_SETUP);
+
+#ifdef PROFILE
+  // Count the hardware events of every simulation thread over each batch
+  auto count_events = [&](bool start) {
+    std::function<void(int)> step = [&](int t) {
+      if (start)
+        profiler.start_counters(t);
+      else
+        profiler.stop_counters(t);
+    };
+    if (pool != NULL) {
+      pool->run(step);
+    } else {
+      #pragma omp parallel
+      step(THREAD_NUM);
+    }
+  };
+#endif
   std::chrono::high_resolution_clock::time_point start, end;
 
-  // Simulate the bracket n times
+  // Simulate the bracket n times. With a target precision, the simulations are
+  // run in batches, and after each batch the number still needed is estimated
+  // from the widest confidence interval, which shrinks as 1/sqrt(n). With
+  // checkpoints, the batches are sized to take about the checkpoint interval,
+  // and a checkpoint is written after each.
+  int64_t num_run = num_resumed;
+  int64_t batch = n - num_run;
+  if (adaptive || !checkpoint_file.empty())
+    batch = (std::min)(batch, (int64_t) FIRST_BATCH);
+  std::chrono::high_resolution_clock::time_point batch_start;
+  float widest = 0.;
   start = std::chrono::high_resolution_clock::now();
-  #pragma omp parallel for schedule(guided)
-  for (int i = 0; i < n; i++) {
-    int t = THREAD_NUM;
-    brackets[t]->simulate();
-    num_sims_per_thread[t] += 1;
-#ifdef PROGRESS_BAR
-    j += 1;
-    if (t == 0) {
-      int pos = j * pbarWidth / n;
-      int pct = j * 100 / n;
-      if (pos != pos_prev || pct != pct_prev) {
-        pos_prev = pos;
-        pct_prev = pct;
-        std::cout << "[" << std::string(pos, '=') << ">" <<
-                  std::string(pbarWidth - pos, ' ') << "] " <<
-                  std::setw(3) << pct << "%\r";
-        std::cout.flush();
+  telemetry.start();
+  if (trace != NULL)
+    trace->start();
+  while (batch > 0) {
+    batch_start = std::chrono::high_resolution_clock::now();
+    PROFILE_PHASE_BEGIN(PHASE_SIMULATION);
+#ifdef PROFILE
+    if (profiler.enabled)
+      count_events(true);
+#endif
+    if (lockstep) {
+      // Blocks start from the batch's first simulation, which only falls
+      // within a block after resuming a run whose n was not a whole number
+      // of blocks
+      LaneBlocks blocks = {num_run, batch};
+      auto simulate_block = [&](int t, int64_t b) {
+        uint64_t first_sim = blocks.first_sim(b);
+        int num_sims = blocks.num_sims(b);
+        PROFILE_SIM_BEGIN(t);
+        if (scenario_batch != NULL)
+          scenario_batch->simulate_block(t, seed, first_sim, num_sims);
+        else
+          engines[t]->simulate(seed, first_sim, num_sims);
+        if (count_meetings)
+          for (int l = 0; l < num_sims; l++)
+            meetings[t]->record(engines[t]->seats.data() + l, engines[t]->results.data() + l,
+                                LANES);
+        if (trace != NULL)
+          trace->record_lanes(t, first_sim, engines[t]->results.data(), num_sims);
+        PROFILE_SIM_END(t, num_sims);
+        telemetry.add(t, num_sims);
+      };
+      if (pool != NULL) {
+        pool->parallel_for(0, blocks.size(), [&](int t, int64_t begin, int64_t end) {
+          for (int64_t b = begin; b < end; b++)
+            simulate_block(t, b);
+        });
+      } else {
+        #pragma omp parallel for schedule(guided)
+        for (int64_t b = 0; b < blocks.size(); b++)
+          simulate_block(THREAD_NUM, b);
+      }
+    } else {
+      auto simulate_one = [&](int t, int64_t i) {
+        PROFILE_SIM_BEGIN(t);
+        if (scenario_batch != NULL)
+          scenario_batch->simulate(t, seed, i);
+        else
+          brackets[t]->simulate(RandomStream(seed, i));
+        if (count_meetings)
+          meetings[t]->record(brackets[t]->seats.data(), brackets[t]->results.data(), 1);
+        if (trace != NULL)
+          trace->record(t, i, brackets[t]->results.data());
+        PROFILE_SIM_END(t, 1);
+        telemetry.add(t, 1);
+      };
+      if (pool != NULL) {
+        pool->parallel_for(num_run, num_run + batch, [&](int t, int64_t begin, int64_t end) {
+          for (int64_t i = begin; i < end; i++)
+            simulate_one(t, i);
+        });
+      } else {
+        #pragma omp parallel for schedule(guided)
+        for (int64_t i = num_run; i < num_run + batch; i++)
+          simulate_one(THREAD_NUM, i);
       }
     }
+#ifdef PROFILE
+    if (profiler.enabled)
+      count_events(false);
 #endif
+    PROFILE_PHASE_END(PHASE_SIMULATION);
+    num_run += batch;
+    PROFILE_PHASE_BEGIN(PHASE_REDUCTION);
+    merge_placings(brackets);
+    PROFILE_PHASE_END(PHASE_REDUCTION);
+    if (!checkpoint_file.empty()) {
+      save_checkpoint(checkpoint_file, brackets[0], checkpoint_flags, seed, n, num_run);
+
+      // Aim for the interval at the rate of the last batch, keeping batches
+      // whole blocks of lanes
+      double seconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() -
+                                                     batch_start).count();
+      double next = seconds > 0. ? batch * checkpoint_interval / seconds : 2. * batch;
+      next = (std::min)((std::max)(next, (double) LANES), (double) n);
+      batch = (std::min)((int64_t) next / LANES * LANES, n - num_run);
+      continue;
+    }
+    if (!adaptive)
+      break;
+
+    // Find the widest interval over all players
+    widest = 0.;
+    std::vector<Player*>& players = brackets[0]->players_in_bracket;
+    for (std::vector<Player*>::iterator it = players.begin(); it != players.end(); it++) {
+      (*it)->calc_intervals(CONFIDENCE_Z);
+      widest = (std::max)(widest, (*it)->avg_points_err);
+      for (int p = 0; p < brackets[0]->num_rounds_P; p++)
+        widest = (std::max)(widest, (*it)->placings_err[p]);
+    }
+    if (widest <= precision || num_run >= n)
+      break;
+
+    // Aim slightly past the estimate, keeping batches whole blocks of lanes
+    double needed = 1.1 * num_run * square(widest / precision) - num_run;
+    needed = (std::min)((std::max)(needed, (double) FIRST_BATCH), (double) n);
+    batch = (std::min)(((int64_t) needed + LANES - 1) / LANES * LANES, n - num_run);
   }
-#ifdef PROGRESS_BAR
-  std::cout << "[" << std::string(pbarWidth + 1, '=') << "] 100%" << std::endl;
-  std::cout << std::endl;
-#endif
+  if (trace != NULL)
+    trace->stop();
   end = std::chrono::high_resolution_clock::now();
+  telemetry.stop();
+  PROFILE_PHASE_BEGIN(PHASE_PRINTING);
 
-  // Combine the results from all the threads
   std::vector<Player*> players_in_bracket = brackets[0]->players_in_bracket;
-  int num_players = brackets[0]->players_in_bracket.size();
-  int num_placings = brackets[0]->players_in_bracket[0]->placings.size();
-  for (int i = 0; i < num_players; i++) {
-    Player* player = players_in_bracket[i];
-    for (int p = 0; p < num_placings; p++)
-      for (int t = 1; t < num_threads; t++)
-        player->placings[p] += brackets[t]->players_in_bracket[i]->placings[p];
-    player->calc_avg_points();
-  }
-
-  // Print results
-  num_placings = brackets[0]->num_rounds_P;
-  std::sort(players_in_bracket.begin(), players_in_bracket.end(), by_avg_points());
-  printf("  %-16s%9s", "Name", "Points");
-  for (int i = 0; i < num_placings; i++) {
-    int placing;
-    if (i < 2) {
-      placing = i + 1;
-    } else {
-      placing = int_power(2, i / 2);
-      placing += (i & 1) * (placing / 2) + 1;
-    }
-    printf("%9s", get_ordinal(placing).c_str());
-  }
-  printf("\n");
-  printf("  %s\n", std::string(25 + 9 * num_placings, '-').c_str());
-  for (std::vector<Player*>::iterator it = players_in_bracket.begin();
-       it != players_in_bracket.end(); it++) {
-    printf("  %-16s  %7.2f", (*it)->name.c_str(), (*it)->avg_points);
-    for (int i = 0; i < num_placings; i++) {
-      printf("  %7u", (*it)->placings[i]);
-    }
-    printf("\n");
+  if (!target_name.empty()) {
+    printf("Importance sampled toward %s, who wins each set with probability at least %.2f\n",
+           target_name.c_str(), tilt);
+    print_target_results(brackets[0], num_run);
+  } else {
+    print_results(players_in_bracket, brackets[0]->num_rounds_P);
+  }
+  if (adaptive) {
+    print_intervals(players_in_bracket, brackets[0]->num_rounds_P);
+    if (widest > precision)
+      throw_warning("Stopped at the limit of " + std::to_string(n) +
+                    " simulations before reaching the target precision");
+    printf("Widest interval: %.4f (target %.4f)\n", widest, precision);
   }
-  printf("\n");
+  if (count_meetings)
+    print_meetings(meetings, brackets[0], num_run, meetings_file);
+  if (!strata_sets.empty())
+    print_strata(brackets[0], num_run);
+  if (scenario_batch != NULL)
+    scenario_batch->print(num_run);
+  n = num_run;
+  PROFILE_PHASE_END(PHASE_PRINTING);
+  PROFILE_REPORT();
 
   // Print timing results
   long dur_ms = std::chrono::  // microseconds
                 duration_cast<std::chrono::microseconds>(end - start).count();
   float duration = (float) dur_ms * 1.e-6;
-  float sims_per_second = n / duration;
+  float sims_per_second = (n - num_resumed) / duration;
   std::cout << "Number of simulations run: " << n << std::endl;
+  if (num_resumed > 0)
+    std::cout << "Resumed after " << num_resumed << " simulations from " << resume_file
+              << std::endl;
+  std::cout << "Seed: " << seed << std::endl;
   std::cout << "Time taken: " << duration << " seconds; "
             << sims_per_second << " per second" << std::endl;
   std::cout << "Number run by each thread:" << std::endl;
   for (int t = 0; t < num_threads; t++)
-    std::cout << num_sims_per_thread[t] << "  ";
+    std::cout << telemetry.count(t) << "  ";
   std::cout << std::endl;
 
   return 0;
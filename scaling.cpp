@@ -0,0 +1,50 @@
+#include <chrono>
+
+#include "Bracket.hpp"
+#include "Lockstep.hpp"
+#include "Synthetic.hpp"
+
+// Scaling benchmark: times the simulation of generated brackets of 64 to 8192
+// entrants, each in a full field and in a field of 3/4 the size whose missing
+// players are byes, with both engines. The time per set should stay flat as
+// the field grows, since every simulation only walks the bracket program.
+
+#define SIMS_PER_PLAYER 1000000  // simulations * entrants run for each field
+
+int main() {
+  printf("  %-8s%9s%9s%12s%14s%14s%14s%14s\n", "Seats", "Players", "Sets", "Bytes",
+         "Scalar us/sim", "Scalar ns/set", "SIMD us/sim", "SIMD ns/set");
+  printf("  %s\n", std::string(94, '-').c_str());
+  for (int num_seats = 64; num_seats <= 8192; num_seats *= 2) {
+    for (int num_players : {num_seats, num_seats / 4 * 3}) {
+      PlayerDatabase database;
+      Bracket* bracket = generate_bracket(num_seats, num_players, database);
+      LockstepEngine* engine = new LockstepEngine(bracket);
+      int num_sims = (std::max)(SIMS_PER_PLAYER / num_players / LANES * LANES, LANES);
+      int num_sets = bracket->program.size();
+      long bytes = num_sets * (sizeof(MatchOp) + sizeof(int)) +
+                   bracket->seats.size() * sizeof(int) +
+                   bracket->placing_seats.size() * sizeof(PlacingSeat) +
+                   num_players * 2 * sizeof(float);
+
+      std::chrono::high_resolution_clock::time_point start, end;
+      start = std::chrono::high_resolution_clock::now();
+      for (int i = 0; i < num_sims; i++)
+        bracket->simulate(RandomStream(1, i));
+      end = std::chrono::high_resolution_clock::now();
+      double scalar_us = std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count() *
+                         1.e-3 / num_sims;
+
+      start = std::chrono::high_resolution_clock::now();
+      for (int b = 0; b < num_sims / LANES; b++)
+        engine->simulate(1, (uint64_t) b * LANES, LANES);
+      end = std::chrono::high_resolution_clock::now();
+      double simd_us = std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count() *
+                       1.e-3 / num_sims;
+
+      printf("  %-8d%9d%9d%12ld%14.2f%14.2f%14.2f%14.2f\n", num_seats, num_players, num_sets,
+             bytes, scalar_us, 1.e3 * scalar_us / num_sets, simd_us, 1.e3 * simd_us / num_sets);
+    }
+  }
+  return 0;
+}
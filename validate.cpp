@@ -0,0 +1,194 @@
+#include <sys/stat.h>
+
+#include "Bracket.hpp"
+#include "Lockstep.hpp"
+#include "Synthetic.hpp"
+
+// Accuracy check of the fast Glicko kernel (Glicko.hpp, --fast-glicko), run
+// by `make validate`. Its approximations are first checked on their own
+// against the standard library, then whole brackets are simulated with the
+// reference and fast kernels from the same random numbers: generated brackets
+// of 32, 128 and 512 entrants, and the bracket in the current directory if
+// there is one (`make validate` uses genesis_4). Each check is listed with
+// its error and tolerance; the program fails if any error is over.
+//
+// Each bracket is also simulated with the SIMD engine in two parts, split
+// within a block of lanes as a run resumed from a checkpoint can be, and the
+// placing counts must equal those of the same simulations run in one go.
+//
+// Placing probabilities are compared in percentage points, with both engines.
+// Ratings and RDs are compared at the end of every simulation in which the
+// two kernels gave the same results, i.e. at the end of every player's
+// trajectory through the bracket, after all of the rounding in the updates
+// along it. A simulation can only go differently where a random number falls
+// between the two kernels' win probabilities, so these are rare.
+
+#define VALIDATE_SEED 1
+#define VALIDATE_SETS 20000000  // Sets played by each kernel with each engine
+
+// Tolerances
+#define MAX_EXP2_ERROR 4.e-6         // Relative
+#define MAX_RSQRT_ERROR 5.e-6        // Relative
+#define MAX_WIN_PROB_ERROR 1.e-5     // Absolute
+#define MAX_PLACING_DIFF 0.05        // Percentage points
+#define MAX_RATING_DIFF 0.05         // Rating points
+#define MAX_RD_DIFF 0.01
+#define MAX_RESUME_DIFF 0            // Placing counts
+
+bool passed = true;
+
+void report(const std::string& name, double error, double tolerance) {
+  bool ok = error <= tolerance;
+  passed = passed && ok;
+  printf("  %-50s%12.3g%12.3g  %s\n", name.c_str(), error, tolerance, ok ? "ok" : "FAIL");
+  fflush(stdout);
+}
+
+// Check the approximations over the ranges the kernel uses them on
+void check_functions() {
+  double error = 0.;
+  for (int i = 0; i <= 1000000; i++) {
+    float x = -126. + 252. * i / 1000000;
+    error = (std::max)(error, fabs(fast_exp2(x) / exp2((double) x) - 1.));
+  }
+  report("fast_exp2, relative", error, MAX_EXP2_ERROR);
+
+  error = 0.;
+  for (int i = 0; i <= 1000000; i++) {
+    float x = pow(10., -8. + 16. * i / 1000000);
+    error = (std::max)(error, fabs(fast_rsqrt(x) * sqrt((double) x) - 1.));
+  }
+  report("fast_rsqrt, relative", error, MAX_RSQRT_ERROR);
+
+  const GlickoConstants constants(pi, q, qs);
+  error = 0.;
+  for (int r = 0; r <= 400; r++)
+    for (int d1 = 30; d1 <= 350; d1 += 10)
+      for (int d2 = 30; d2 <= 350; d2 += 10) {
+        float dif = -1000. + 5. * r;
+        error = (std::max)(error, (double) fabs(fast_win_probability(dif, d1, 0., d2, constants) -
+                                                win_probability(dif, d1, 0., d2)));
+      }
+  report("fast_win_probability, absolute", error, MAX_WIN_PROB_ERROR);
+}
+
+// Return the largest difference between the placing counts of two brackets,
+// out of n simulations, in percentage points
+double placing_diff(Bracket* ref, Bracket* fast, int64_t n) {
+  double diff = 0.;
+  for (int i = 0; i < ref->num_players * ref->num_rounds_P; i++)
+    diff = (std::max)(diff, 100. * llabs(ref->placing_counts[i] - fast->placing_counts[i]) / n);
+  return diff;
+}
+
+// Simulate the bracket with the SIMD engine in one go, then split into two
+// parts, the first not a whole number of blocks, and compare the counts
+void check_resume(Bracket* bracket, int64_t n) {
+  LockstepEngine* engine = new LockstepEngine(bracket);
+  int size = bracket->num_players * bracket->num_rounds_P;
+  std::vector<int64_t> whole(size);
+  int64_t split = n / 2 + LANES / 2 + 1;
+  for (LaneBlocks blocks : {LaneBlocks{0, n}, LaneBlocks{0, split}, LaneBlocks{split, n - split}}) {
+    if (blocks.first == 0)
+      bracket->clear_placings();
+    for (int64_t b = 0; b < blocks.size(); b++)
+      engine->simulate(VALIDATE_SEED, blocks.first_sim(b), blocks.num_sims(b));
+    if (blocks.count == n)
+      std::copy(bracket->placing_counts, bracket->placing_counts + size, whole.begin());
+  }
+  int64_t diff = 0;
+  for (int i = 0; i < size; i++)
+    diff = (std::max)(diff, (int64_t) llabs(bracket->placing_counts[i] - whole[i]));
+  report("Placing counts, SIMD run split mid-block", diff, MAX_RESUME_DIFF);
+  delete engine;
+}
+
+// Simulate two copies of a bracket with the reference and fast kernels and
+// compare them
+void check_bracket(const std::string& name, Bracket* ref, Bracket* fast) {
+  int64_t n = (std::max)((int64_t) VALIDATE_SETS / (int64_t) ref->program.size() / LANES * LANES,
+                         (int64_t) LANES);
+  printf("%s, %" PRId64 " simulations:\n", name.c_str(), n);
+
+  int64_t same = 0;
+  double rating_diff = 0., RD_diff = 0.;
+  ref->clear_placings();
+  fast->clear_placings();
+  for (int64_t i = 0; i < n; i++) {
+    fast_glicko = false;
+    ref->simulate(RandomStream(VALIDATE_SEED, i));
+    fast_glicko = true;
+    fast->simulate(RandomStream(VALIDATE_SEED, i));
+    if (ref->results != fast->results)
+      continue;
+    same++;
+    for (int p = 0; p < ref->num_players; p++) {
+      rating_diff = (std::max)(rating_diff, (double) fabs(ref->rating[p] - fast->rating[p]));
+      RD_diff = (std::max)(RD_diff, (double) fabs(ref->RD[p] - fast->RD[p]));
+    }
+  }
+  report("Placing probabilities, scalar engine", placing_diff(ref, fast, n), MAX_PLACING_DIFF);
+  report("Final ratings", rating_diff, MAX_RATING_DIFF);
+  report("Final RDs", RD_diff, MAX_RD_DIFF);
+  printf("  (the kernels' results differ in %.4f%% of simulations)\n", 100. * (n - same) / n);
+
+  LockstepEngine* ref_engine = new LockstepEngine(ref);
+  LockstepEngine* fast_engine = new LockstepEngine(fast);
+  ref->clear_placings();
+  fast->clear_placings();
+  for (int64_t b = 0; b < n / LANES; b++) {
+    fast_glicko = false;
+    ref_engine->simulate(VALIDATE_SEED, (uint64_t) b * LANES, LANES);
+    fast_glicko = true;
+    fast_engine->simulate(VALIDATE_SEED, (uint64_t) b * LANES, LANES);
+  }
+  report("Placing probabilities, SIMD engine", placing_diff(ref, fast, n), MAX_PLACING_DIFF);
+  delete ref_engine;
+  delete fast_engine;
+  fast_glicko = false;
+
+  check_resume(ref, n);
+  printf("\n");
+}
+
+int main() {
+  printf("  %-50s%12s%12s\n", "Check", "Error", "Tolerance");
+  printf("  %s\n", std::string(74, '-').c_str());
+  check_functions();
+  printf("\n");
+
+  for (int entrants : {32, 128, 512}) {
+    PlayerDatabase ref_database, fast_database;
+    Bracket* ref = generate_bracket(entrants, entrants, ref_database);
+    Bracket* fast = generate_bracket(entrants, entrants, fast_database);
+    check_bracket("Generated bracket of " + std::to_string(entrants) + " entrants", ref, fast);
+    delete ref;
+    delete fast;
+  }
+
+  struct stat info;
+  if (stat("bracket_params.txt", &info) == 0) {
+    int num_W, num_L;
+    std::vector<std::vector<int>> wl_map, res_fixed_W, res_fixed_L, res_fixed_G;
+    load_bracket_params(num_W, num_L, wl_map, res_fixed_W, res_fixed_L, res_fixed_G);
+    std::vector<std::string> players_W, players_L;
+    load_initial_players(players_W, players_L);
+    PlayerDatabase database;
+    load_player_data(database);
+
+    Bracket* brackets[2];
+    for (int b = 0; b < 2; b++) {
+      brackets[b] = new Bracket(num_W, num_L);
+      brackets[b]->set_player_database(&database);
+      brackets[b]->set_structure(wl_map);
+      brackets[b]->set_initial_players(players_W, players_L, b);
+      brackets[b]->set_res_fixed(res_fixed_W, res_fixed_L, res_fixed_G);
+    }
+    check_bracket("Bracket in the current directory", brackets[0], brackets[1]);
+    delete brackets[0];
+    delete brackets[1];
+  }
+
+  printf(passed ? "All checks passed\n" : "Some checks FAILED\n");
+  return passed ? 0 : EXIT_FAILURE;
+}